@@ -11,90 +11,241 @@
 #import "BFCancellationToken.h"
 #import "BFCancellationTokenRegistration.h"
 
-NS_ASSUME_NONNULL_BEGIN
+#import <sched.h>
 
-@interface BFCancellationToken ()
+#import "BFAtomics.h"
+#import "BFClock.h"
+#import "BFTimerWheel.h"
 
-@property (nullable, nonatomic, strong) NSMutableArray *registrations;
-@property (nonatomic, strong) NSObject *lock;
-@property (nonatomic) BOOL disposed;
+NS_ASSUME_NONNULL_BEGIN
 
-@end
+/*
+ The whole state of a token lives in a single word: the head of the intrusive list of registrations,
+ tagged with the flags below (registrations are objects, so the low bits of their address are always clear).
+ Registering pushes onto the head, cancelling and disposing take the whole list at once,
+ and disposing a registration only clears its block. Disposed registrations are unlinked in bulk once they make up
+ half of the list, which keeps registering and disposing O(1) amortized.
+ */
+static const uintptr_t BFCancellationTokenStateCancelledBit = 0x1;
+static const uintptr_t BFCancellationTokenStateDisposedBit = 0x2;
+static const uintptr_t BFCancellationTokenStateCompactingBit = 0x4;
+static const uintptr_t BFCancellationTokenStateFlags = (BFCancellationTokenStateCancelledBit |
+                                                        BFCancellationTokenStateDisposedBit |
+                                                        BFCancellationTokenStateCompactingBit);
+
+// Compacting a list shorter than this is not worth it.
+static const intptr_t BFCancellationTokenMinimumCompactionCount = 16;
 
 @interface BFCancellationTokenRegistration (BFCancellationToken)
 
-+ (instancetype)registrationWithToken:(BFCancellationToken *)token delegate:(BFCancellationBlock)delegate;
++ (instancetype)registrationWithToken:(nullable BFCancellationToken *)token delegate:(BFCancellationBlock)delegate;
+
+// The next registration in the list of the token, only written before the registration is published.
+@property (nullable, nonatomic, unsafe_unretained) BFCancellationTokenRegistration *next;
+@property (nonatomic, assign, readonly, getter=isDisposed) BOOL disposed;
 
 - (void)notifyDelegate;
+- (void)disposeWithoutToken;
 
 @end
 
-@implementation BFCancellationToken
-
-@synthesize cancellationRequested = _cancellationRequested;
+@implementation BFCancellationToken {
+    atomic_uintptr_t _state;
+    // The number of registrations in the list, and how many of them are disposed.
+    // Signed, as a compaction can account for a disposal before the disposal itself does.
+    atomic_intptr_t _registrationCount;
+    atomic_intptr_t _disposedRegistrationCount;
+    // The retained `BFTimerWheelEntry` of `cancelAtDeadline:`, if any.
+    _Atomic(CFTypeRef) _cancellationEntry;
+}
 
 #pragma mark - Initializer
 
-- (instancetype)init {
-    self = [super init];
-    if (!self) return self;
-
-    _registrations = [NSMutableArray array];
-    _lock = [NSObject new];
-
-    return self;
+- (void)dealloc {
+    uintptr_t state = atomic_load_explicit(&_state, memory_order_acquire);
+    [self releaseRegistrations:(__bridge BFCancellationTokenRegistration *)(void *)(state & ~BFCancellationTokenStateFlags)
+                       dispose:YES];
+    CFTypeRef cancellationEntry = atomic_load_explicit(&_cancellationEntry, memory_order_acquire);
+    if (cancellationEntry) {
+        [[BFTimerWheel sharedTimerWheel] cancelEntry:(__bridge BFTimerWheelEntry *)cancellationEntry];
+        CFRelease(cancellationEntry);
+    }
 }
 
 #pragma mark - Custom Setters/Getters
 
 - (BOOL)isCancellationRequested {
-    @synchronized(self.lock) {
+    uintptr_t state = atomic_load_explicit(&_state, memory_order_acquire);
+    if (state & BFCancellationTokenStateDisposedBit) {
         [self throwIfDisposed];
-        return _cancellationRequested;
     }
+    return (state & BFCancellationTokenStateCancelledBit) != 0;
 }
 
 - (void)cancel {
-    NSArray *registrations;
-    @synchronized(self.lock) {
+    if (![self cancelUnlessDisposed]) {
         [self throwIfDisposed];
-        if (_cancellationRequested) {
-            return;
-        }
-        [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(cancelPrivate) object:nil];
-        _cancellationRequested = YES;
-        registrations = [self.registrations copy];
     }
+}
 
-    [self notifyCancellation:registrations];
+/*!
+ Cancels the token, unless it is disposed.
+ Used where cancellation is triggered on behalf of the owner of the token, like a scheduled or a linked cancellation,
+ which can race with the owner disposing of it.
+ @returns `NO` if the token is disposed.
+ */
+- (BOOL)cancelUnlessDisposed {
+    uintptr_t state = [self takeRegistrationsSettingFlag:BFCancellationTokenStateCancelledBit];
+    if (state & BFCancellationTokenStateDisposedBit) {
+        return NO;
+    }
+    if (state & BFCancellationTokenStateCancelledBit) {
+        return YES;
+    }
+
+    [self cancelScheduledCancellation];
+    [self notifyCancellation:(__bridge BFCancellationTokenRegistration *)(void *)(state & ~BFCancellationTokenStateFlags)];
+    return YES;
 }
 
-- (void)notifyCancellation:(NSArray *)registrations {
-    for (BFCancellationTokenRegistration *registration in registrations) {
+- (void)notifyCancellation:(nullable BFCancellationTokenRegistration *)registrations {
+    // The list was built by pushing onto its head, reverse it to notify observers in registration order.
+    NSMutableArray<BFCancellationTokenRegistration *> *orderedRegistrations = [NSMutableArray array];
+    for (BFCancellationTokenRegistration *registration = registrations; registration; registration = registration.next) {
+        [orderedRegistrations addObject:registration];
+    }
+    for (BFCancellationTokenRegistration *registration in orderedRegistrations.reverseObjectEnumerator) {
         [registration notifyDelegate];
     }
+    [self releaseRegistrations:registrations dispose:NO];
 }
 
 - (BFCancellationTokenRegistration *)registerCancellationObserverWithBlock:(BFCancellationBlock)block {
-    @synchronized(self.lock) {
-        BFCancellationTokenRegistration *registration = [BFCancellationTokenRegistration registrationWithToken:self delegate:[block copy]];
-        [self.registrations addObject:registration];
+    BFCancellationTokenRegistration *registration = [BFCancellationTokenRegistration registrationWithToken:self
+                                                                                                  delegate:[block copy]];
+    CFTypeRef retainedRegistration = CFBridgingRetain(registration);
+
+    uintptr_t state = atomic_load_explicit(&_state, memory_order_relaxed);
+    do {
+        if (state & (BFCancellationTokenStateCancelledBit | BFCancellationTokenStateDisposedBit)) {
+            CFRelease(retainedRegistration);
+            if (state & BFCancellationTokenStateCancelledBit) {
+                [registration notifyDelegate];
+            } else {
+                [registration disposeWithoutToken];
+            }
+            return registration;
+        }
+        registration.next = (__bridge BFCancellationTokenRegistration *)(void *)(state & ~BFCancellationTokenStateFlags);
+    } while (!atomic_compare_exchange_weak_explicit(&_state,
+                                                    &state,
+                                                    (uintptr_t)retainedRegistration | (state & BFCancellationTokenStateFlags),
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+    atomic_fetch_add_explicit(&_registrationCount, 1, memory_order_relaxed);
+    return registration;
+}
 
-        return registration;
+- (void)registrationDidDispose {
+    intptr_t disposedCount = atomic_fetch_add_explicit(&_disposedRegistrationCount, 1, memory_order_relaxed) + 1;
+    intptr_t count = atomic_load_explicit(&_registrationCount, memory_order_relaxed);
+    if (disposedCount >= BFCancellationTokenMinimumCompactionCount && disposedCount * 2 >= count) {
+        [self compactRegistrations];
     }
 }
 
-- (void)unregisterRegistration:(BFCancellationTokenRegistration *)registration {
-    @synchronized(self.lock) {
-        [self throwIfDisposed];
-        [self.registrations removeObject:registration];
+/*!
+ Unlinks every disposed registration from the list.
+ */
+- (void)compactRegistrations {
+    // Lock the list against cancellation, disposal and other compactions. Pushes onto the head are still allowed.
+    uintptr_t state = atomic_load_explicit(&_state, memory_order_relaxed);
+    do {
+        if (state & BFCancellationTokenStateFlags) {
+            return;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&_state,
+                                                    &state,
+                                                    state | BFCancellationTokenStateCompactingBit,
+                                                    memory_order_acquire,
+                                                    memory_order_relaxed));
+    state |= BFCancellationTokenStateCompactingBit;
+
+    BFCancellationTokenRegistration *removedRegistrations = nil;
+    intptr_t removedCount = 0;
+    BFCancellationTokenRegistration *previous = nil;
+    BFCancellationTokenRegistration *registration = (__bridge BFCancellationTokenRegistration *)(void *)(state & ~BFCancellationTokenStateFlags);
+    while (registration) {
+        BFCancellationTokenRegistration *next = registration.next;
+        if (!registration.disposed) {
+            previous = registration;
+            registration = next;
+            continue;
+        }
+
+        if (previous) {
+            // Registrations past the head are only ever touched by the holder of the compacting bit.
+            previous.next = next;
+        } else {
+            uintptr_t newState = (uintptr_t)(__bridge void *)next | BFCancellationTokenStateCompactingBit;
+            if (!atomic_compare_exchange_strong_explicit(&_state,
+                                                         &state,
+                                                         newState,
+                                                         memory_order_relaxed,
+                                                         memory_order_relaxed)) {
+                // A registration was pushed meanwhile, this one is not the head anymore. Walk again from the new head.
+                previous = nil;
+                registration = (__bridge BFCancellationTokenRegistration *)(void *)(state & ~BFCancellationTokenStateFlags);
+                continue;
+            }
+            state = newState;
+        }
+        registration.next = removedRegistrations;
+        removedRegistrations = registration;
+        removedCount++;
+        registration = next;
+    }
+
+    atomic_fetch_and_explicit(&_state, ~BFCancellationTokenStateCompactingBit, memory_order_release);
+    atomic_fetch_sub_explicit(&_registrationCount, removedCount, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&_disposedRegistrationCount, removedCount, memory_order_relaxed);
+    [self releaseRegistrations:removedRegistrations dispose:NO];
+}
+
+/*!
+ Sets the flag and takes the whole list of registrations, once no compaction is in progress.
+ @returns The previous state, with the list of registrations if neither the token was cancelled nor disposed.
+ */
+- (uintptr_t)takeRegistrationsSettingFlag:(uintptr_t)flag {
+    uintptr_t state = atomic_load_explicit(&_state, memory_order_relaxed);
+    while (YES) {
+        // Nothing is left to take from a disposed token, or from one that has the flag set already.
+        if (state & (BFCancellationTokenStateDisposedBit | flag)) {
+            return state;
+        }
+        if (state & BFCancellationTokenStateCompactingBit) {
+            sched_yield();
+            state = atomic_load_explicit(&_state, memory_order_relaxed);
+            continue;
+        }
+        uintptr_t newState = (state & BFCancellationTokenStateCancelledBit) | flag;
+        if (atomic_compare_exchange_weak_explicit(&_state, &state, newState, memory_order_acq_rel, memory_order_relaxed)) {
+            return state;
+        }
     }
 }
 
-// Delay on a non-public method to prevent interference with a user calling performSelector or
-// cancelPreviousPerformRequestsWithTarget on the public method
-- (void)cancelPrivate {
-    [self cancel];
+- (void)releaseRegistrations:(nullable BFCancellationTokenRegistration *)registrations dispose:(BOOL)dispose {
+    BFCancellationTokenRegistration *registration = registrations;
+    while (registration) {
+        BFCancellationTokenRegistration *next = registration.next;
+        registration.next = nil;
+        if (dispose) {
+            [registration disposeWithoutToken];
+        }
+        CFRelease((__bridge CFTypeRef)registration);
+        registration = next;
+    }
 }
 
 - (void)cancelAfterDelay:(int)millis {
@@ -108,33 +259,53 @@ NS_ASSUME_NONNULL_BEGIN
         return;
     }
 
-    @synchronized(self.lock) {
-        [self throwIfDisposed];
-        [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(cancelPrivate) object:nil];
-        if (self.cancellationRequested) {
-            return;
-        }
+    [self cancelAtDeadline:(millis == -1 ? DISPATCH_TIME_FOREVER : dispatch_time(DISPATCH_TIME_NOW, millis * NSEC_PER_MSEC))];
+}
 
-        if (millis != -1) {
-            double delay = (double)millis / 1000;
-            [self performSelector:@selector(cancelPrivate) withObject:nil afterDelay:delay];
-        }
+- (void)cancelAtDeadline:(dispatch_time_t)deadline {
+    [self throwIfDisposed];
+
+    CFTypeRef cancellationEntry = NULL;
+    if (!self.cancellationRequested && deadline != DISPATCH_TIME_FOREVER) {
+        // Scheduled cancellations run on the timer wheel, so that they need no run loop
+        // and are not tied to the thread that scheduled them.
+        __weak BFCancellationToken *weakSelf = self;
+        BFTimerWheelEntry *entry = [[BFTimerWheel sharedTimerWheel] scheduleBlock:^{
+            [weakSelf cancelUnlessDisposed];
+        } atDeadline:BFClockNanosecondsFromDispatchTime(deadline)];
+        cancellationEntry = CFBridgingRetain(entry);
+    }
+    [self cancelCancellationEntry:atomic_exchange(&_cancellationEntry, cancellationEntry)];
+
+    // A cancellation that raced with scheduling this one left it behind.
+    if (atomic_load_explicit(&_state, memory_order_acquire) & (BFCancellationTokenStateCancelledBit | BFCancellationTokenStateDisposedBit)) {
+        [self cancelScheduledCancellation];
+    }
+}
+
+- (void)cancelScheduledCancellation {
+    [self cancelCancellationEntry:atomic_exchange(&_cancellationEntry, NULL)];
+}
+
+- (void)cancelCancellationEntry:(nullable CFTypeRef)cancellationEntry {
+    if (cancellationEntry) {
+        [[BFTimerWheel sharedTimerWheel] cancelEntry:(__bridge BFTimerWheelEntry *)cancellationEntry];
+        CFRelease(cancellationEntry);
     }
 }
 
 - (void)dispose {
-    @synchronized(self.lock) {
-        if (self.disposed) {
-            return;
-        }
-        [self.registrations makeObjectsPerformSelector:@selector(dispose)];
-        self.registrations = nil;
-        self.disposed = YES;
+    uintptr_t state = [self takeRegistrationsSettingFlag:BFCancellationTokenStateDisposedBit];
+    if (state & BFCancellationTokenStateDisposedBit) {
+        return;
     }
+    [self releaseRegistrations:(__bridge BFCancellationTokenRegistration *)(void *)(state & ~BFCancellationTokenStateFlags)
+                       dispose:YES];
+    [self cancelScheduledCancellation];
 }
 
 - (void)throwIfDisposed {
-    if (self.disposed) {
+    if (atomic_load_explicit(&_state, memory_order_acquire) & BFCancellationTokenStateDisposedBit) {
         [NSException raise:NSInternalInconsistencyException format:@"Object already disposed"];
     }
 }
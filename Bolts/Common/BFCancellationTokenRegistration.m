@@ -10,68 +10,72 @@
 
 #import "BFCancellationTokenRegistration.h"
 
+#import "BFAtomics.h"
 #import "BFCancellationToken.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
 @interface BFCancellationTokenRegistration ()
 
-@property (nonatomic, weak) BFCancellationToken *token;
-@property (nullable, nonatomic, strong) BFCancellationBlock cancellationObserverBlock;
-@property (nonatomic, strong) NSObject *lock;
-@property (nonatomic) BOOL disposed;
+@property (nullable, nonatomic, weak) BFCancellationToken *token;
+@property (nullable, nonatomic, unsafe_unretained) BFCancellationTokenRegistration *next;
 
 @end
 
 @interface BFCancellationToken (BFCancellationTokenRegistration)
 
-- (void)unregisterRegistration:(BFCancellationTokenRegistration *)registration;
+- (void)registrationDidDispose;
 
 @end
 
-@implementation BFCancellationTokenRegistration
+@implementation BFCancellationTokenRegistration {
+    // The retained cancellation observer block, cleared once it is either notified or disposed.
+    _Atomic(CFTypeRef) _cancellationObserverBlock;
+}
 
-+ (instancetype)registrationWithToken:(BFCancellationToken *)token delegate:(BFCancellationBlock)delegate {
++ (instancetype)registrationWithToken:(nullable BFCancellationToken *)token delegate:(BFCancellationBlock)delegate {
     BFCancellationTokenRegistration *registration = [BFCancellationTokenRegistration new];
     registration.token = token;
-    registration.cancellationObserverBlock = delegate;
+    atomic_init(&registration->_cancellationObserverBlock, CFBridgingRetain([delegate copy]));
     return registration;
 }
 
-- (instancetype)init {
-    self = [super init];
-    if (!self) return self;
+- (void)dealloc {
+    CFTypeRef block = atomic_load_explicit(&_cancellationObserverBlock, memory_order_acquire);
+    if (block) {
+        CFRelease(block);
+    }
+}
 
-    _lock = [NSObject new];
-    
-    return self;
+- (BOOL)isDisposed {
+    return atomic_load_explicit(&_cancellationObserverBlock, memory_order_acquire) == NULL;
 }
 
 - (void)dispose {
-    @synchronized(self.lock) {
-        if (self.disposed) {
-            return;
-        }
-        self.disposed = YES;
+    if (![self takeCancellationObserverBlock]) {
+        return;
     }
+    // Lets the token unlink disposed registrations once there are enough of them.
+    [self.token registrationDidDispose];
+}
 
-    BFCancellationToken *token = self.token;
-    if (token != nil) {
-        [token unregisterRegistration:self];
-        self.token = nil;
-    }
-    self.cancellationObserverBlock = nil;
+- (void)disposeWithoutToken {
+    [self takeCancellationObserverBlock];
 }
 
 - (void)notifyDelegate {
-    @synchronized(self.lock) {
-        [self throwIfDisposed];
-        self.cancellationObserverBlock();
+    BFCancellationBlock block = [self takeCancellationObserverBlock];
+    if (block) {
+        block();
     }
 }
 
-- (void)throwIfDisposed {
-    NSAssert(!self.disposed, @"Object already disposed");
+/*!
+ Takes the block, so that it is either notified or disposed, and only once.
+ */
+- (nullable BFCancellationBlock)takeCancellationObserverBlock {
+    CFTypeRef block = atomic_exchange_explicit(&_cancellationObserverBlock, NULL, memory_order_acq_rel);
+    return block ? (BFCancellationBlock)CFBridgingRelease(block) : nil;
 }
 
 @end
@@ -27,6 +27,16 @@ NS_ASSUME_NONNULL_BEGIN
  */
 + (instancetype)cancellationTokenSource;
 
+/*!
+ Creates a new cancellation token source that is cancelled as soon as any of the given tokens is cancelled,
+ right away if one of them is already.
+ Cancellation propagates down any number of levels of linked sources, for as long as the linked token is around,
+ even if the source itself is not. A linked source unregisters from the tokens once it is cancelled or disposed,
+ or once its token is deallocated, so that long-lived tokens don't accumulate observers.
+ @param tokens The tokens to link the new token source to.
+ */
++ (instancetype)cancellationTokenSourceLinkedToTokens:(NSArray<BFCancellationToken *> *)tokens;
+
 /*!
  The cancellation token associated with this CancellationTokenSource.
  */
@@ -49,6 +59,14 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)cancelAfterDelay:(int)millis;
 
+/*!
+ Schedules a cancel operation on this CancellationTokenSource once the deadline has passed.
+ Unlike a run loop timer, the cancellation fires regardless of the thread it was scheduled from.
+ @param deadline The deadline, made with `dispatch_time()` or `dispatch_walltime()`.
+ If it is `DISPATCH_TIME_FOREVER` any scheduled cancellation is stopped.
+ */
+- (void)cancelAtDeadline:(dispatch_time_t)deadline;
+
 /*!
  Releases all resources associated with this token source,
  including disposing of all registrations.
@@ -11,20 +11,56 @@
 #import "BFCancellationTokenSource.h"
 
 #import "BFCancellationToken.h"
+#import "BFCancellationTokenRegistration.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
 @interface BFCancellationToken (BFCancellationTokenSource)
 
 - (void)cancel;
+- (BOOL)cancelUnlessDisposed;
 - (void)cancelAfterDelay:(int)millis;
+- (void)cancelAtDeadline:(dispatch_time_t)deadline;
 
 - (void)dispose;
 - (void)throwIfDisposed;
 
 @end
 
-@implementation BFCancellationTokenSource
+/*!
+ Holds the registrations of a linked token with its parents, and disposes them when it goes away.
+ Only the observer on the linked token itself holds it, so the registrations stay for as long as the token does,
+ no matter who keeps the token source around.
+ */
+@interface BFCancellationTokenParentRegistrations : NSObject
+
+@property (nonatomic, copy, readonly) NSArray<BFCancellationTokenRegistration *> *registrations;
+
+- (instancetype)initWithRegistrations:(NSArray<BFCancellationTokenRegistration *> *)registrations;
+
+@end
+
+@implementation BFCancellationTokenParentRegistrations
+
+- (instancetype)initWithRegistrations:(NSArray<BFCancellationTokenRegistration *> *)registrations {
+    self = [super init];
+    if (!self) return self;
+
+    _registrations = [registrations copy];
+
+    return self;
+}
+
+- (void)dealloc {
+    [_registrations makeObjectsPerformSelector:@selector(dispose)];
+}
+
+@end
+
+@implementation BFCancellationTokenSource {
+    // The registrations with the tokens this source is linked to, for disposing them along with the source.
+    NSArray<BFCancellationTokenRegistration *> *_Nullable _parentRegistrations;
+}
 
 #pragma mark - Initializer
 
@@ -41,6 +77,32 @@ NS_ASSUME_NONNULL_BEGIN
     return [BFCancellationTokenSource new];
 }
 
++ (instancetype)cancellationTokenSourceLinkedToTokens:(NSArray<BFCancellationToken *> *)tokens {
+    BFCancellationTokenSource *source = [BFCancellationTokenSource new];
+
+    // A single observer is shared by all of the parents, and doesn't keep the child alive.
+    __weak BFCancellationToken *weakToken = source.token;
+    BFCancellationBlock cancellationBlock = ^{
+        [weakToken cancelUnlessDisposed];
+    };
+    NSMutableArray<BFCancellationTokenRegistration *> *parentRegistrations = [NSMutableArray arrayWithCapacity:tokens.count];
+    for (BFCancellationToken *token in tokens) {
+        [parentRegistrations addObject:[token registerCancellationObserverWithBlock:cancellationBlock]];
+    }
+    source->_parentRegistrations = [parentRegistrations copy];
+
+    // The observer keeps the registrations for as long as the token lives, even once the source is gone.
+    // Once cancelled, the child has no use for the parents anymore, unlink it from them right away.
+    // If the token goes away first, disposing its observers releases the holder, which unlinks it all the same.
+    BFCancellationTokenParentRegistrations *registrations =
+        [[BFCancellationTokenParentRegistrations alloc] initWithRegistrations:parentRegistrations];
+    [source.token registerCancellationObserverWithBlock:^{
+        [registrations.registrations makeObjectsPerformSelector:@selector(dispose)];
+    }];
+
+    return source;
+}
+
 #pragma mark - Custom Setters/Getters
 
 - (BOOL)isCancellationRequested {
@@ -55,8 +117,13 @@ NS_ASSUME_NONNULL_BEGIN
     [_token cancelAfterDelay:millis];
 }
 
+- (void)cancelAtDeadline:(dispatch_time_t)deadline {
+    [_token cancelAtDeadline:deadline];
+}
+
 - (void)dispose {
     [_token dispose];
+    [_parentRegistrations makeObjectsPerformSelector:@selector(dispose)];
 }
 
 @end
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*!
+ An error code used in `BFTaskErrorDomain` for <BFChannel send:>, if the channel was closed before the send
+ or while it waited for room. The error the channel was closed with, if any, is under `NSUnderlyingErrorKey`.
+ */
+extern NSInteger const kBFChannelClosedError;
+
+@class BFTask<__covariant ResultType>;
+
+/*!
+ A bounded buffer of objects, passed from producers to consumers in order.
+ Sending and receiving return tasks, so a pipeline waits for the other side with continuations instead of threads.
+
+ A send completes as soon as its objects are in the buffer, with a task that is already completed while there is
+ room, so producers only wait once the buffer is full. A receive takes as many buffered objects as it asks for at once,
+ so consumers can move data in batches instead of waiting on one task per object.
+
+ Closing the channel ends the stream after the objects that are in the buffer: receives get them first,
+ and then the end of the stream, or the error the channel was closed with. Sends that still wait for room fail.
+ */
+@interface BFChannel<ObjectType> : NSObject
+
+/*!
+ Creates an open channel.
+ @param capacity The number of objects the channel buffers before sends have to wait, must be greater than `0`.
+ */
++ (instancetype)channelWithCapacity:(NSUInteger)capacity;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/*!
+ The number of objects the channel buffers before sends have to wait.
+ */
+@property (nonatomic, assign, readonly) NSUInteger capacity;
+
+/*!
+ Whether the channel was closed. A closed channel may still have objects to receive.
+ */
+@property (nonatomic, assign, readonly, getter=isClosed) BOOL closed;
+
+/*!
+ Sends an object to the channel.
+ @param object The object to send.
+ @returns A task that completes with a `nil` result once the object is in the buffer,
+ or that fails with `kBFChannelClosedError` if the channel is closed first.
+ */
+- (BFTask *)send:(ObjectType)object;
+
+/*!
+ Sends objects to the channel, in order and without objects of other sends in between.
+ If they don't all fit, they are buffered as room becomes available.
+ @param objects The objects to send.
+ @returns A task that completes with a `nil` result once all of the objects are in the buffer,
+ or that fails with `kBFChannelClosedError` if the channel is closed first. The objects that were buffered by then
+ are still received.
+ */
+- (BFTask *)sendObjects:(NSArray<ObjectType> *)objects;
+
+/*!
+ Receives the next object of the channel.
+ @returns A task that completes with the next object, with a `nil` result once the channel is closed
+ and all of its objects were received, or with the error the channel was closed with.
+ */
+- (BFTask<ObjectType> *)receive;
+
+/*!
+ Receives the next objects of the channel, as many as are available but at least one.
+ @param maximumCount The number of objects to receive at most, must be greater than `0`.
+ @returns A task that completes with the next objects, with an empty array once the channel is closed
+ and all of its objects were received, or with the error the channel was closed with.
+ */
+- (BFTask<NSArray<ObjectType> *> *)receiveObjectsWithMaximumCount:(NSUInteger)maximumCount;
+
+/*!
+ Closes the channel. Later sends fail, and so do the sends still waiting for room.
+ Receives get the objects that are in the buffer and then the end of the stream.
+ Closing a closed channel does nothing.
+ */
+- (void)close;
+
+/*!
+ Closes the channel with an error. Later sends fail, and so do the sends still waiting for room.
+ Receives get the objects that are in the buffer and then the error.
+ Closing a closed channel does nothing.
+ @param error The error to fail the receives with after the last object, or `nil` to close like <close>.
+ */
+- (void)closeWithError:(nullable NSError *)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,332 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import "BFChannel.h"
+
+#import <pthread.h>
+
+#import "BFTask.h"
+#import "BFTaskCompletionSource.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+NSInteger const kBFChannelClosedError = 80175003;
+
+/*!
+ Objects of a send that did not fit in the buffer, waiting for room.
+ */
+@interface BFChannelSend : NSObject
+
+@property (nonatomic, copy, readonly) NSArray *objects;
+@property (nonatomic, assign) NSUInteger bufferedCount;
+@property (nonatomic, strong, readonly) BFTaskCompletionSource *source;
+
+- (instancetype)initWithObjects:(NSArray *)objects bufferedCount:(NSUInteger)bufferedCount;
+
+@end
+
+@implementation BFChannelSend
+
+- (instancetype)initWithObjects:(NSArray *)objects bufferedCount:(NSUInteger)bufferedCount {
+    self = [super init];
+    if (!self) return self;
+
+    _objects = [objects copy];
+    _bufferedCount = bufferedCount;
+    _source = [BFTaskCompletionSource taskCompletionSource];
+
+    return self;
+}
+
+@end
+
+/*!
+ A receive that found the buffer empty, waiting for objects.
+ */
+@interface BFChannelReceive : NSObject
+
+@property (nonatomic, assign, readonly) NSUInteger maximumCount;
+// Whether the receive is for a single object, rather than an array of objects.
+@property (nonatomic, assign, readonly, getter=isSingle) BOOL single;
+@property (nonatomic, strong, readonly) BFTaskCompletionSource *source;
+
+- (instancetype)initWithMaximumCount:(NSUInteger)maximumCount single:(BOOL)single;
+
+@end
+
+@implementation BFChannelReceive
+
+- (instancetype)initWithMaximumCount:(NSUInteger)maximumCount single:(BOOL)single {
+    self = [super init];
+    if (!self) return self;
+
+    _maximumCount = maximumCount;
+    _single = single;
+    _source = [BFTaskCompletionSource taskCompletionSource];
+
+    return self;
+}
+
+@end
+
+/*!
+ Completes the tasks of sends and receives, once the lock is released,
+ since their continuations may run inline and use the channel again.
+ */
+static void BFChannelRunCompletions(NSArray<dispatch_block_t> *_Nullable completions) {
+    for (dispatch_block_t completion in completions) {
+        completion();
+    }
+}
+
+/*!
+ The error of sends that the channel was closed before, with the error it was closed with as the underlying one.
+ */
+static NSError *BFChannelClosedError(NSError *_Nullable closeError) {
+    NSDictionary *userInfo = (closeError ? @{ NSUnderlyingErrorKey : closeError } : nil);
+    return [NSError errorWithDomain:BFTaskErrorDomain code:kBFChannelClosedError userInfo:userInfo];
+}
+
+static BFTask *BFChannelReceivedTask(NSArray *objects, BOOL single) {
+    return [BFTask taskWithResult:(single ? objects.firstObject : objects)];
+}
+
+@implementation BFChannel {
+    NSUInteger _capacity;
+
+    // Guarded by the lock.
+    // Sends only wait while the buffer is full, and receives only while it is empty.
+    pthread_mutex_t _lock;
+    NSMutableArray *_buffer;
+    NSMutableArray<BFChannelSend *> *_pendingSends;
+    NSMutableArray<BFChannelReceive *> *_pendingReceives;
+    BOOL _closed;
+    NSError *_Nullable _closeError;
+}
+
+#pragma mark - Initializer
+
++ (instancetype)channelWithCapacity:(NSUInteger)capacity {
+    return [[self alloc] initWithCapacity:capacity];
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+    self = [super init];
+    if (!self) return self;
+
+    // The lock is set up first, as -dealloc destroys it even when the capacity is rejected.
+    pthread_mutex_init(&_lock, NULL);
+    if (capacity == 0) {
+        [NSException raise:NSInvalidArgumentException format:@"A channel needs a capacity of at least one object."];
+    }
+
+    _capacity = capacity;
+    _buffer = [NSMutableArray array];
+    _pendingSends = [NSMutableArray array];
+    _pendingReceives = [NSMutableArray array];
+
+    return self;
+}
+
+- (void)dealloc {
+    pthread_mutex_destroy(&_lock);
+}
+
+#pragma mark - State
+
+- (NSUInteger)capacity {
+    return _capacity;
+}
+
+- (BOOL)isClosed {
+    pthread_mutex_lock(&_lock);
+    BOOL closed = _closed;
+    pthread_mutex_unlock(&_lock);
+    return closed;
+}
+
+#pragma mark - Sending
+
+- (BFTask *)send:(id)object {
+    return [self sendObjects:@[ object ]];
+}
+
+- (BFTask *)sendObjects:(NSArray *)objects {
+    pthread_mutex_lock(&_lock);
+    if (_closed) {
+        NSError *error = _closeError;
+        pthread_mutex_unlock(&_lock);
+        return [BFTask taskWithError:BFChannelClosedError(error)];
+    }
+
+    // Buffer what fits right away, unless earlier sends are still waiting for room.
+    NSUInteger bufferedCount = 0;
+    if (_pendingSends.count == 0) {
+        bufferedCount = MIN(objects.count, _capacity - _buffer.count);
+        if (bufferedCount == objects.count) {
+            [_buffer addObjectsFromArray:objects];
+        } else {
+            [_buffer addObjectsFromArray:[objects subarrayWithRange:NSMakeRange(0, bufferedCount)]];
+        }
+    }
+
+    BFTask *task = nil;
+    if (bufferedCount < objects.count) {
+        BFChannelSend *send = [[BFChannelSend alloc] initWithObjects:objects bufferedCount:bufferedCount];
+        [_pendingSends addObject:send];
+        task = send.source.task;
+    }
+    NSArray<dispatch_block_t> *completions = [self transferObjects];
+    pthread_mutex_unlock(&_lock);
+
+    BFChannelRunCompletions(completions);
+    return task ?: [BFTask taskWithResult:nil];
+}
+
+#pragma mark - Receiving
+
+- (BFTask *)receive {
+    return [self receiveObjectsWithMaximumCount:1 single:YES];
+}
+
+- (BFTask<NSArray *> *)receiveObjectsWithMaximumCount:(NSUInteger)maximumCount {
+    if (maximumCount == 0) {
+        [NSException raise:NSInvalidArgumentException format:@"A receive needs to take at least one object."];
+    }
+    return [self receiveObjectsWithMaximumCount:maximumCount single:NO];
+}
+
+- (BFTask *)receiveObjectsWithMaximumCount:(NSUInteger)maximumCount single:(BOOL)single {
+    pthread_mutex_lock(&_lock);
+    if (_buffer.count > 0) {
+        NSArray *objects = [self takeObjectsWithMaximumCount:maximumCount];
+        // The taken objects made room for sends that are waiting.
+        NSArray<dispatch_block_t> *completions = [self transferObjects];
+        pthread_mutex_unlock(&_lock);
+
+        BFChannelRunCompletions(completions);
+        return BFChannelReceivedTask(objects, single);
+    }
+    if (_closed) {
+        NSError *error = _closeError;
+        pthread_mutex_unlock(&_lock);
+        return (error ? [BFTask taskWithError:error] : BFChannelReceivedTask(@[], single));
+    }
+
+    BFChannelReceive *receive = [[BFChannelReceive alloc] initWithMaximumCount:maximumCount single:single];
+    [_pendingReceives addObject:receive];
+    pthread_mutex_unlock(&_lock);
+    return receive.source.task;
+}
+
+#pragma mark - Closing
+
+- (void)close {
+    [self closeWithError:nil];
+}
+
+- (void)closeWithError:(nullable NSError *)error {
+    pthread_mutex_lock(&_lock);
+    if (_closed) {
+        pthread_mutex_unlock(&_lock);
+        return;
+    }
+    _closed = YES;
+    _closeError = error;
+
+    // Sends still waiting for room would never complete otherwise. Whatever they already buffered stays there.
+    NSArray<BFChannelSend *> *sends = _pendingSends;
+    _pendingSends = [NSMutableArray array];
+    NSArray<dispatch_block_t> *completions = [self transferObjects];
+    pthread_mutex_unlock(&_lock);
+
+    NSError *sendError = BFChannelClosedError(error);
+    for (BFChannelSend *send in sends) {
+        [send.source setError:sendError];
+    }
+    BFChannelRunCompletions(completions);
+}
+
+#pragma mark - Transfer
+
+/*!
+ Removes up to the given number of objects from the front of the buffer, which must not be empty.
+ Must be called with the lock held.
+ */
+- (NSArray *)takeObjectsWithMaximumCount:(NSUInteger)maximumCount {
+    if (maximumCount >= _buffer.count) {
+        // Hand the whole buffer over instead of copying it.
+        NSArray *objects = _buffer;
+        _buffer = [NSMutableArray arrayWithCapacity:_capacity];
+        return objects;
+    }
+    NSRange range = NSMakeRange(0, maximumCount);
+    NSArray *objects = [_buffer subarrayWithRange:range];
+    [_buffer removeObjectsInRange:range];
+    return objects;
+}
+
+/*!
+ Moves objects of waiting sends into the buffer and from the buffer to waiting receives, as far as possible,
+ and ends the waiting receives once the channel is closed and drained.
+ Must be called with the lock held.
+ @returns The blocks that complete the tasks of the sends and receives that are done, to run without the lock.
+ */
+- (nullable NSArray<dispatch_block_t> *)transferObjects {
+    NSMutableArray<dispatch_block_t> *completions = nil;
+    for (;;) {
+        while (_pendingSends.count > 0 && _buffer.count < _capacity) {
+            BFChannelSend *send = _pendingSends.firstObject;
+            NSUInteger count = MIN(send.objects.count - send.bufferedCount, _capacity - _buffer.count);
+            [_buffer addObjectsFromArray:[send.objects subarrayWithRange:NSMakeRange(send.bufferedCount, count)]];
+            send.bufferedCount += count;
+            if (send.bufferedCount == send.objects.count) {
+                [_pendingSends removeObjectAtIndex:0];
+                completions = completions ?: [NSMutableArray array];
+                [completions addObject:^{
+                    [send.source setResult:nil];
+                }];
+            }
+        }
+
+        if (_pendingReceives.count == 0 || _buffer.count == 0) {
+            break;
+        }
+        BFChannelReceive *receive = _pendingReceives.firstObject;
+        [_pendingReceives removeObjectAtIndex:0];
+        NSArray *objects = [self takeObjectsWithMaximumCount:receive.maximumCount];
+        completions = completions ?: [NSMutableArray array];
+        [completions addObject:^{
+            [receive.source setResult:(receive.single ? objects.firstObject : objects)];
+        }];
+    }
+
+    // Sends refill the buffer first, so an empty buffer means that nothing was left to receive.
+    if (_closed && _buffer.count == 0 && _pendingReceives.count > 0) {
+        NSArray<BFChannelReceive *> *receives = _pendingReceives;
+        _pendingReceives = [NSMutableArray array];
+        NSError *error = _closeError;
+        completions = completions ?: [NSMutableArray array];
+        [completions addObject:^{
+            for (BFChannelReceive *receive in receives) {
+                if (error) {
+                    [receive.source setError:error];
+                } else {
+                    [receive.source setResult:(receive.single ? nil : @[])];
+                }
+            }
+        }];
+    }
+    return completions;
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -12,14 +12,25 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+/*!
+ The priority lanes of the thread pool executors, and of the internal scheduling of Bolts (like delays),
+ matching the priorities of the global dispatch queues.
+ */
+typedef NS_ENUM(NSInteger, BFExecutorPriority) {
+    BFExecutorPriorityBackground = 0,
+    BFExecutorPriorityLow = 1,
+    BFExecutorPriorityDefault = 2,
+    BFExecutorPriorityHigh = 3,
+};
+
 /*!
  An object that can run a given block.
  */
 @interface BFExecutor : NSObject
 
 /*!
- Returns a default executor, which runs continuations immediately until the call stack gets too
- deep, then dispatches to a new GCD queue.
+ Returns a default executor, which runs continuations immediately until they are nested too deeply,
+ then queues them on the current thread to be run once the outermost continuation returns.
  */
 + (instancetype)defaultExecutor;
 
@@ -51,12 +62,55 @@ NS_ASSUME_NONNULL_BEGIN
  */
 + (instancetype)executorWithOperationQueue:(NSOperationQueue *)queue;
 
+/*!
+ Returns a shared executor that runs continuations on a pool of worker threads, one per active processor
+ and at least two.
+ Continuations scheduled from one of the workers are run by that same worker whenever possible,
+ while idle workers steal pending continuations from busy ones.
+ Each continuation inherits the priority of the thread that schedules it, see `currentPriority`.
+ */
++ (instancetype)threadPoolExecutor;
+
+/*!
+ Returns a shared executor that runs continuations on the same pool as `threadPoolExecutor`, with the given priority.
+ Workers always run higher priority continuations first, and at least one worker stays available for
+ the default and high priorities while low priority and background continuations saturate the others.
+ @param priority The priority of every continuation, and of whatever they schedule in turn.
+ */
++ (instancetype)threadPoolExecutorWithPriority:(BFExecutorPriority)priority;
+
+/*!
+ Returns a new executor that runs continuations on a new pool of worker threads.
+ Continuations scheduled from one of the workers are run by that same worker whenever possible,
+ while idle workers steal pending continuations from busy ones.
+ The worker threads live for the lifetime of the process, so this executor should be created once and reused.
+ Keeping a worker available for the default and high priorities takes at least two workers: with a single one,
+ a long low priority or background continuation holds up everything else.
+ @param workerCount The number of worker threads, must be greater than `0`.
+ */
++ (instancetype)threadPoolExecutorWithWorkerCount:(NSUInteger)workerCount;
+
+/*!
+ The priority of the block that runs on the current thread: the priority it was scheduled with on a thread pool
+ or by a delay, which the continuations it schedules inherit. `BFExecutorPriorityDefault` anywhere else.
+ */
++ (BFExecutorPriority)currentPriority;
+
 /*!
  Runs the given block using this executor's particular strategy.
  @param block The block to execute.
  */
 - (void)execute:(void(^)(void))block;
 
+/*!
+ Runs the given blocks using this executor's particular strategy, as if each was passed to `execute:` in order.
+ Executors that can do so without changing how the blocks run relative to each other, like the main thread executor,
+ submit them in fewer operations than one per block. Executors of global dispatch queues submit them once, and the
+ blocks are then submitted from the queue itself, each on its own so that they still run concurrently.
+ @param blocks The blocks to execute.
+ */
+- (void)executeBlocks:(NSArray<void(^)(void)> *)blocks;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -10,39 +10,235 @@
 
 #import "BFExecutor.h"
 
-#import <pthread.h>
+#import "BFAtomics.h"
+#import "BFExecutor_Internal.h"
+#import "BFThreadPool.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
 /*!
- Get the remaining stack-size of the current thread.
+ Number of default executor continuations that can be nested on a thread before further ones are trampolined.
+ A level of nesting takes a handful of frames, a few hundred bytes in all unless the continuations themselves use
+ more, so this stays well within the 512 KB stack of a secondary thread.
+ */
+static const NSUInteger BFExecutorMaximumInlineDepth = 256;
+
+/*!
+ A per-thread FIFO of continuations deferred by the default executor, drained by the outermost continuation.
+ */
+typedef struct BFExecutorTrampoline {
+    NSUInteger depth;
+    CFTypeRef *blocks;
+    NSUInteger capacity;
+    NSUInteger head;
+    NSUInteger count;
+} BFExecutorTrampoline;
 
- @param totalSize The total stack size of the current thread.
+static __thread BFExecutorTrampoline BFExecutorCurrentTrampoline;
 
- @return The remaining size, in bytes, available to the current thread.
+static void BFExecutorTrampolineEnqueue(BFExecutorTrampoline *trampoline, dispatch_block_t block) {
+    if (trampoline->count == trampoline->capacity) {
+        NSUInteger capacity = MAX(trampoline->capacity * 2, (NSUInteger)16);
+        CFTypeRef *blocks = malloc(sizeof(CFTypeRef) * capacity);
+        for (NSUInteger i = 0; i < trampoline->count; i++) {
+            blocks[i] = trampoline->blocks[(trampoline->head + i) % trampoline->capacity];
+        }
+        free(trampoline->blocks);
+        trampoline->blocks = blocks;
+        trampoline->capacity = capacity;
+        trampoline->head = 0;
+    }
+    trampoline->blocks[(trampoline->head + trampoline->count) % trampoline->capacity] = CFBridgingRetain([block copy]);
+    trampoline->count++;
+}
 
- @note This function cannot be inlined, as otherwise the internal implementation could fail to report the proper
- remaining stack space.
+static dispatch_block_t _Nullable BFExecutorTrampolineDequeue(BFExecutorTrampoline *trampoline) {
+    if (trampoline->count == 0) {
+        return nil;
+    }
+    CFTypeRef block = trampoline->blocks[trampoline->head];
+    trampoline->head = (trampoline->head + 1) % trampoline->capacity;
+    trampoline->count--;
+    return (dispatch_block_t)CFBridgingRelease(block);
+}
+
+void BFExecutorDrainCurrentThreadTrampolineUntil(BOOL (*isDone)(void *context), void *context) {
+    BFExecutorTrampoline *trampoline = &BFExecutorCurrentTrampoline;
+    dispatch_block_t block = nil;
+    while (!isDone(context) && (block = BFExecutorTrampolineDequeue(trampoline))) {
+        @autoreleasepool {
+            block();
+        }
+    }
+}
+
+/*!
+ Called by the default executor once a continuation that it ran inline returned.
+ The outermost one drains the trampoline, and every deferred continuation runs at the depth of 1,
+ so the stack stays bounded however long the chain is.
  */
-__attribute__((noinline)) static size_t remaining_stack_size(size_t *restrict totalSize) {
-    pthread_t currentThread = pthread_self();
+static void BFExecutorTrampolineDidRunInline(BFExecutorTrampoline *trampoline) {
+    if (trampoline->depth != 0 || !trampoline->blocks) {
+        return;
+    }
+    dispatch_block_t deferredBlock = nil;
+    while ((deferredBlock = BFExecutorTrampolineDequeue(trampoline))) {
+        trampoline->depth = 1;
+        @autoreleasepool {
+            deferredBlock();
+        }
+        trampoline->depth = 0;
+    }
+    free(trampoline->blocks);
+    trampoline->blocks = NULL;
+    trampoline->capacity = 0;
+    trampoline->head = 0;
+}
+
+BOOL BFExecutorTryRunInline(BFExecutor *executor, void (*function)(void *context), void *context) {
+    if (executor == [BFExecutor immediateExecutor]) {
+        function(context);
+        return YES;
+    }
+    if (executor != [BFExecutor defaultExecutor]) {
+        return NO;
+    }
 
-    // NOTE: We must store stack pointers as uint8_t so that the pointer math is well-defined
-    uint8_t *endStack = pthread_get_stackaddr_np(currentThread);
-    *totalSize = pthread_get_stacksize_np(currentThread);
+    // Same as the default executor, except that a continuation that has to be deferred is left to the caller.
+    BFExecutorTrampoline *trampoline = &BFExecutorCurrentTrampoline;
+    if (trampoline->depth >= BFExecutorMaximumInlineDepth) {
+        return NO;
+    }
+    trampoline->depth++;
+    @autoreleasepool {
+        function(context);
+    }
+    trampoline->depth--;
+    BFExecutorTrampolineDidRunInline(trampoline);
+    return YES;
+}
+
+/*!
+ The priority of the block that runs on the current thread, plus one, so that `0` stands for none.
+ */
+static __thread NSInteger BFExecutorCurrentPriorityStorage;
 
-    // NOTE: If the function is inlined, this value could be incorrect
-    uint8_t *frameAddr = __builtin_frame_address(0);
+BFExecutorPriority BFExecutorCurrentPriority(void) {
+    NSInteger storage = BFExecutorCurrentPriorityStorage;
+    return storage ? (BFExecutorPriority)(storage - 1) : BFExecutorPriorityDefault;
+}
 
-    return (*totalSize) - (size_t)(endStack - frameAddr);
+void BFExecutorRunBlockWithPriority(BFExecutorPriority priority, dispatch_block_t block) {
+    NSInteger previousStorage = BFExecutorCurrentPriorityStorage;
+    BFExecutorCurrentPriorityStorage = priority + 1;
+    block();
+    BFExecutorCurrentPriorityStorage = previousStorage;
 }
 
-@interface BFExecutor ()
+static long BFExecutorDispatchQueuePriority(BFExecutorPriority priority) {
+    switch (priority) {
+        case BFExecutorPriorityBackground:
+            return DISPATCH_QUEUE_PRIORITY_BACKGROUND;
+        case BFExecutorPriorityLow:
+            return DISPATCH_QUEUE_PRIORITY_LOW;
+        case BFExecutorPriorityDefault:
+            return DISPATCH_QUEUE_PRIORITY_DEFAULT;
+        case BFExecutorPriorityHigh:
+            return DISPATCH_QUEUE_PRIORITY_HIGH;
+    }
+    return DISPATCH_QUEUE_PRIORITY_DEFAULT;
+}
+
+void BFExecutorDispatchAsyncWithPriority(BFExecutorPriority priority, dispatch_block_t block) {
+    dispatch_queue_t queue = dispatch_get_global_queue(BFExecutorDispatchQueuePriority(priority), 0);
+    if (priority == BFExecutorPriorityDefault) {
+        // Blocks of global queues run with the default priority already.
+        dispatch_async(queue, block);
+        return;
+    }
+    dispatch_async(queue, ^{
+        BFExecutorRunBlockWithPriority(priority, block);
+    });
+}
+
+static void BFExecutorRunBlocks(NSArray<dispatch_block_t> *blocks) {
+    for (dispatch_block_t block in blocks) {
+        @autoreleasepool {
+            block();
+        }
+    }
+}
+
+/*!
+ Submits every block in the range but the first to the queue, by halves, and then runs the first one.
+ Each block still runs in a submission of its own, so they run concurrently just like with one submission per block,
+ while submitting them is spread over the threads that run them instead of falling to a single one.
+ */
+static void BFExecutorFanOutBlocks(dispatch_queue_t queue, NSArray<dispatch_block_t> *blocks, NSRange range) {
+    while (range.length > 1) {
+        NSUInteger half = range.length / 2;
+        NSRange upperRange = NSMakeRange(range.location + half, range.length - half);
+        dispatch_async(queue, ^{
+            BFExecutorFanOutBlocks(queue, blocks, upperRange);
+        });
+        range.length = half;
+    }
+    @autoreleasepool {
+        blocks[range.location]();
+    }
+}
+
+/*!
+ Whether the queue is one of the global concurrent queues, which don't order blocks relative to each other anyway.
+ */
+static BOOL BFExecutorIsGlobalQueue(dispatch_queue_t queue) {
+    static dispatch_queue_t globalQueues[5];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        globalQueues[0] = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0);
+        globalQueues[1] = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0);
+        globalQueues[2] = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+        globalQueues[3] = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
+#if __APPLE__
+        globalQueues[4] = dispatch_get_global_queue(QOS_CLASS_USER_INTERACTIVE, 0);
+#endif
+    });
+    for (size_t i = 0; i < sizeof(globalQueues) / sizeof(globalQueues[0]); i++) {
+        if (queue == globalQueues[i]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+@interface BFExecutor () {
+@package
+    // Continuations submitted to this executor while instrumentation was enabled, and how many of them started.
+    atomic_uint_fast64_t _instrumentedContinuationsScheduled;
+    atomic_uint_fast64_t _instrumentedContinuationsStarted;
+}
 
 @property (nonatomic, copy) void(^block)(void(^block)(void));
+/// Submits several blocks at once, if this executor has a cheaper way to do that than submitting them one by one.
+@property (nullable, nonatomic, copy) void(^batchBlock)(NSArray<dispatch_block_t> *blocks);
 
 @end
 
+void BFExecutorCountScheduledContinuation(BFExecutor *executor) {
+    atomic_fetch_add_explicit(&executor->_instrumentedContinuationsScheduled, 1, memory_order_relaxed);
+}
+
+void BFExecutorCountStartedContinuation(BFExecutor *executor) {
+    atomic_fetch_add_explicit(&executor->_instrumentedContinuationsStarted, 1, memory_order_relaxed);
+}
+
+uint64_t BFExecutorQueuedContinuationCount(BFExecutor *executor) {
+    // Started first, so that a continuation that starts in between is not counted as started but not scheduled.
+    uint64_t started = atomic_load_explicit(&executor->_instrumentedContinuationsStarted, memory_order_relaxed);
+    uint64_t scheduled = atomic_load_explicit(&executor->_instrumentedContinuationsScheduled, memory_order_relaxed);
+    return scheduled > started ? scheduled - started : 0;
+}
+
 @implementation BFExecutor
 
 #pragma mark - Executor methods
@@ -53,18 +249,20 @@ __attribute__((noinline)) static size_t remaining_stack_size(size_t *restrict to
     dispatch_once(&onceToken, ^{
         defaultExecutor = [self executorWithBlock:^void(void(^block)(void)) {
             // We prefer to run everything possible immediately, so that there is callstack information
-            // when debugging. However, we don't want the stack to get too deep, so if the remaining stack space
-            // is less than 10% of the total space, we dispatch to another GCD queue.
-            size_t totalStackSize = 0;
-            size_t remainingStackSize = remaining_stack_size(&totalStackSize);
+            // when debugging. However, we don't want the stack to get too deep, so once continuations are nested
+            // deeply enough, we queue them on this thread instead, to be run by the outermost continuation.
+            BFExecutorTrampoline *trampoline = &BFExecutorCurrentTrampoline;
+            if (trampoline->depth >= BFExecutorMaximumInlineDepth) {
+                BFExecutorTrampolineEnqueue(trampoline, block);
+                return;
+            }
 
-            if (remainingStackSize < (totalStackSize / 10)) {
-                dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), block);
-            } else {
-                @autoreleasepool {
-                    block();
-                }
+            trampoline->depth++;
+            @autoreleasepool {
+                block();
             }
+            trampoline->depth--;
+            BFExecutorTrampolineDidRunInline(trampoline);
         }];
     });
     return defaultExecutor;
@@ -94,6 +292,15 @@ __attribute__((noinline)) static size_t remaining_stack_size(size_t *restrict to
                 }
             }
         }];
+        mainThreadExecutor.batchBlock = ^(NSArray<dispatch_block_t> *blocks) {
+            if (![NSThread isMainThread]) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    BFExecutorRunBlocks(blocks);
+                });
+            } else {
+                BFExecutorRunBlocks(blocks);
+            }
+        };
     });
     return mainThreadExecutor;
 }
@@ -103,15 +310,91 @@ __attribute__((noinline)) static size_t remaining_stack_size(size_t *restrict to
 }
 
 + (instancetype)executorWithDispatchQueue:(dispatch_queue_t)queue {
-    return [self executorWithBlock:^void(void(^block)(void)) {
+    BFExecutor *executor = [self executorWithBlock:^void(void(^block)(void)) {
         dispatch_async(queue, block);
     }];
+    // Running several blocks in one submission only behaves like running each on its own if the queue is serial,
+    // otherwise a block could wait forever for one queued behind it. The main queue is the only one known to be serial.
+    // The global queues are known to be concurrent, the batch is fanned out from a single submission there.
+    // Fanning out would let later submissions of the same thread overtake the batch on a serial queue, so any other
+    // queue, which could be either, still gets one submission per block.
+    if (queue == dispatch_get_main_queue()) {
+        executor.batchBlock = ^(NSArray<dispatch_block_t> *blocks) {
+            dispatch_async(queue, ^{
+                BFExecutorRunBlocks(blocks);
+            });
+        };
+    } else if (BFExecutorIsGlobalQueue(queue)) {
+        executor.batchBlock = ^(NSArray<dispatch_block_t> *blocks) {
+            dispatch_async(queue, ^{
+                BFExecutorFanOutBlocks(queue, blocks, NSMakeRange(0, blocks.count));
+            });
+        };
+    }
+    return executor;
 }
 
 + (instancetype)executorWithOperationQueue:(NSOperationQueue *)queue {
-    return [self executorWithBlock:^void(void(^block)(void)) {
+    BFExecutor *executor = [self executorWithBlock:^void(void(^block)(void)) {
         [queue addOperation:[NSBlockOperation blockOperationWithBlock:block]];
     }];
+    executor.batchBlock = ^(NSArray<dispatch_block_t> *blocks) {
+        NSMutableArray<NSOperation *> *operations = [NSMutableArray arrayWithCapacity:blocks.count];
+        for (dispatch_block_t block in blocks) {
+            [operations addObject:[NSBlockOperation blockOperationWithBlock:block]];
+        }
+        [queue addOperations:operations waitUntilFinished:NO];
+    };
+    return executor;
+}
+
++ (instancetype)threadPoolExecutor {
+    static BFExecutor *threadPoolExecutor = NULL;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        threadPoolExecutor = [self threadPoolExecutorWithThreadPool:[self sharedThreadPool]];
+    });
+    return threadPoolExecutor;
+}
+
++ (instancetype)threadPoolExecutorWithPriority:(BFExecutorPriority)priority {
+    if (priority < BFExecutorPriorityBackground || priority > BFExecutorPriorityHigh) {
+        [NSException raise:NSInvalidArgumentException format:@"Unknown executor priority %ld", (long)priority];
+    }
+
+    static BFExecutor *threadPoolExecutors[BFExecutorPriorityCount];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        BFThreadPool *threadPool = [self sharedThreadPool];
+        for (NSUInteger i = 0; i < BFExecutorPriorityCount; i++) {
+            BFExecutorPriority lanePriority = (BFExecutorPriority)i;
+            threadPoolExecutors[i] = [self executorWithBlock:^void(void(^block)(void)) {
+                [threadPool enqueueBlock:block priority:lanePriority];
+            }];
+        }
+    });
+    return threadPoolExecutors[priority];
+}
+
++ (instancetype)threadPoolExecutorWithWorkerCount:(NSUInteger)workerCount {
+    return [self threadPoolExecutorWithThreadPool:[[BFThreadPool alloc] initWithWorkerCount:workerCount]];
+}
+
++ (instancetype)threadPoolExecutorWithThreadPool:(BFThreadPool *)threadPool {
+    return [self executorWithBlock:^void(void(^block)(void)) {
+        [threadPool enqueueBlock:block priority:BFExecutorCurrentPriority()];
+    }];
+}
+
++ (BFThreadPool *)sharedThreadPool {
+    static BFThreadPool *threadPool = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        // A second worker, even on a single processor, keeps one free for the default and high priorities.
+        NSUInteger workerCount = MAX([NSProcessInfo processInfo].activeProcessorCount, (NSUInteger)2);
+        threadPool = [[BFThreadPool alloc] initWithWorkerCount:workerCount];
+    });
+    return threadPool;
 }
 
 #pragma mark - Initializer
@@ -125,12 +408,29 @@ __attribute__((noinline)) static size_t remaining_stack_size(size_t *restrict to
     return self;
 }
 
+#pragma mark - Priority
+
++ (BFExecutorPriority)currentPriority {
+    return BFExecutorCurrentPriority();
+}
+
 #pragma mark - Execution
 
 - (void)execute:(void(^)(void))block {
     self.block(block);
 }
 
+- (void)executeBlocks:(NSArray<void(^)(void)> *)blocks {
+    void(^batchBlock)(NSArray<dispatch_block_t> *) = self.batchBlock;
+    if (batchBlock) {
+        batchBlock(blocks);
+        return;
+    }
+    for (dispatch_block_t block in blocks) {
+        self.block(block);
+    }
+}
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -0,0 +1,144 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class BFExecutor;
+@class BFTask;
+
+/*!
+ The lifecycle events of tasks and of their continuations.
+ */
+typedef NS_ENUM(NSInteger, BFInstrumentationEventType) {
+    /// A task was created, either pending or already completed.
+    BFInstrumentationEventTypeTaskCreated,
+    /// A continuation was registered on a task with `continueWithExecutor:block:cancellationToken:`
+    /// or one of its variants.
+    BFInstrumentationEventTypeContinuationRegistered,
+    /// A pending task was completed.
+    BFInstrumentationEventTypeTaskCompleted,
+    /// A continuation was submitted to its executor, as its task is completed.
+    BFInstrumentationEventTypeContinuationScheduled,
+    /// The executor started running a continuation.
+    BFInstrumentationEventTypeContinuationStarted,
+    /// A continuation returned. Its dependent task may still be pending, if the continuation returned a task.
+    BFInstrumentationEventTypeContinuationFinished,
+};
+
+/*!
+ A lifecycle event. The objects it refers to are not retained, and are only valid while the observer is called.
+ */
+typedef struct BFInstrumentationEvent {
+    BFInstrumentationEventType type;
+    /// The time of the event, in nanoseconds of a monotonic clock that matches `DISPATCH_TIME_NOW`.
+    uint64_t timestamp;
+    /// The task the event is about. For continuation events, the task the continuation was registered on.
+    __unsafe_unretained BFTask *task;
+    /// For `BFInstrumentationEventTypeContinuationRegistered`, the task the continuation completes, `nil` otherwise.
+    /// Also `nil` for a continuation of a completed task that its executor runs right away, as its outcome is
+    /// returned without a dependent task. Match the other events of the continuation with `continuation`.
+    __unsafe_unretained BFTask *_Nullable dependentTask;
+    /// For continuation events, the executor that runs the continuation, `nil` otherwise.
+    __unsafe_unretained BFExecutor *_Nullable executor;
+    /// Identifies one continuation across its events, `0` for task events.
+    uintptr_t continuation;
+} BFInstrumentationEvent;
+
+/*!
+ Called synchronously, on the thread the event happens on, for every event.
+ It has to be thread-safe and fast, and must not retain the objects of the event past the call.
+ */
+typedef void (*BFInstrumentationEventObserver)(const BFInstrumentationEvent *event);
+
+/*!
+ Counts of events since instrumentation was enabled, or since the counters were last reset.
+ */
+typedef struct BFInstrumentationCounters {
+    uint64_t tasksCreated;
+    uint64_t tasksCompleted;
+    /// Only counts the tasks whose creation was counted, even if instrumentation was disabled in between.
+    uint64_t tasksDeallocated;
+    uint64_t continuationsRegistered;
+    uint64_t continuationsScheduled;
+    uint64_t continuationsStarted;
+    uint64_t continuationsFinished;
+    /// The sum, over every started continuation, of the time between its scheduling and its start.
+    uint64_t continuationStartLatencyNanoseconds;
+} BFInstrumentationCounters;
+
+/*!
+ The number of tasks created and not deallocated yet, among the tasks created while instrumentation was enabled.
+ Tasks that were alive when the counters were reset are not counted as created, but still as deallocated,
+ which this clamps at zero.
+ */
+static inline uint64_t BFInstrumentationCountersLiveTasks(BFInstrumentationCounters counters) {
+    return counters.tasksCreated > counters.tasksDeallocated ? counters.tasksCreated - counters.tasksDeallocated : 0;
+}
+
+/*!
+ The number of continuations submitted to their executors and not started yet, across every executor.
+ See `+[BFInstrumentation queuedContinuationCountForExecutor:]` for the depth of the queue of one executor.
+ */
+static inline uint64_t BFInstrumentationCountersQueuedContinuations(BFInstrumentationCounters counters) {
+    return counters.continuationsScheduled > counters.continuationsStarted
+        ? counters.continuationsScheduled - counters.continuationsStarted
+        : 0;
+}
+
+/*!
+ Opt-in instrumentation of the task lifecycle.
+ While disabled, which is the default, every hook costs a single relaxed load of a flag.
+ Building Bolts with `BF_INSTRUMENTATION=0` removes the hooks altogether.
+ */
+@interface BFInstrumentation : NSObject
+
+/*!
+ Whether events are counted and sent to the observer.
+ */
++ (BOOL)isEnabled;
+
+/*!
+ Enables or disables instrumentation. Events that happen concurrently may or may not be recorded.
+ */
++ (void)setEnabled:(BOOL)enabled;
+
+/*!
+ The function called for every event while instrumentation is enabled, `NULL` by default.
+ */
++ (nullable BFInstrumentationEventObserver)eventObserver;
+
++ (void)setEventObserver:(nullable BFInstrumentationEventObserver)eventObserver;
+
+/*!
+ Returns a snapshot of the counters. Each counter is read atomically, but not all of them at the same instant.
+ */
++ (BFInstrumentationCounters)counters;
+
+/*!
+ The number of continuations submitted to the given executor while instrumentation was enabled, and not started yet.
+ Unlike the counters, this is kept per executor and is not reset, so it stays exact whenever it is sampled.
+ Continuations that run right away on the current thread are never queued, and are not counted.
+ */
++ (uint64_t)queuedContinuationCountForExecutor:(BFExecutor *)executor;
+
+/*!
+ Sets every counter back to zero.
+ The live tasks and queued continuations are only exact again once what was alive or queued at the reset is gone.
+ */
++ (void)resetCounters;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+@end
+
+NS_ASSUME_NONNULL_END
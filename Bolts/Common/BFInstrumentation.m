@@ -0,0 +1,235 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import "BFInstrumentation.h"
+
+#import "BFClock.h"
+#import "BFExecutor_Internal.h"
+#import "BFInstrumentation_Internal.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+atomic_bool BFInstrumentationEnabledFlag;
+
+static _Atomic(BFInstrumentationEventObserver) BFInstrumentationCurrentEventObserver;
+
+/*!
+ The counters, each on its own cache line, so that threads counting different events don't contend.
+ */
+typedef struct BFInstrumentationCounter {
+    atomic_uint_fast64_t value;
+    char padding[64 - sizeof(atomic_uint_fast64_t)];
+} BFInstrumentationCounter;
+
+static BFInstrumentationCounter BFInstrumentationTasksCreated;
+static BFInstrumentationCounter BFInstrumentationTasksCompleted;
+static BFInstrumentationCounter BFInstrumentationTasksDeallocated;
+static BFInstrumentationCounter BFInstrumentationContinuationsRegistered;
+static BFInstrumentationCounter BFInstrumentationContinuationsScheduled;
+static BFInstrumentationCounter BFInstrumentationContinuationsStarted;
+static BFInstrumentationCounter BFInstrumentationContinuationsFinished;
+static BFInstrumentationCounter BFInstrumentationContinuationStartLatency;
+
+static inline void BFInstrumentationCounterAdd(BFInstrumentationCounter *counter, uint64_t value) {
+    atomic_fetch_add_explicit(&counter->value, value, memory_order_relaxed);
+}
+
+static inline uint64_t BFInstrumentationCounterLoad(BFInstrumentationCounter *counter) {
+    return atomic_load_explicit(&counter->value, memory_order_relaxed);
+}
+
+static void BFInstrumentationSendEvent(BFInstrumentationEventType type,
+                                       uint64_t timestamp,
+                                       BFTask *task,
+                                       BFTask *_Nullable dependentTask,
+                                       BFExecutor *_Nullable executor,
+                                       uintptr_t continuation) {
+    BFInstrumentationEventObserver observer = atomic_load_explicit(&BFInstrumentationCurrentEventObserver,
+                                                                   memory_order_acquire);
+    if (!observer) {
+        return;
+    }
+    BFInstrumentationEvent event = {
+        .type = type,
+        .timestamp = timestamp,
+        .task = task,
+        .dependentTask = dependentTask,
+        .executor = executor,
+        .continuation = continuation,
+    };
+    observer(&event);
+}
+
+#pragma mark - Hooks
+
+void BFInstrumentationTaskCreated(BFTask *task) {
+    BFInstrumentationCounterAdd(&BFInstrumentationTasksCreated, 1);
+    BFInstrumentationSendEvent(BFInstrumentationEventTypeTaskCreated, BFClockNowNanoseconds(), task, nil, nil, 0);
+}
+
+void BFInstrumentationTaskCompleted(BFTask *task) {
+    BFInstrumentationCounterAdd(&BFInstrumentationTasksCompleted, 1);
+    BFInstrumentationSendEvent(BFInstrumentationEventTypeTaskCompleted, BFClockNowNanoseconds(), task, nil, nil, 0);
+}
+
+void BFInstrumentationTaskDeallocated(void) {
+    BFInstrumentationCounterAdd(&BFInstrumentationTasksDeallocated, 1);
+}
+
+void BFInstrumentationContinuationRegistered(BFTask *task, BFTask *dependentTask, BFExecutor *executor) {
+    BFInstrumentationCounterAdd(&BFInstrumentationContinuationsRegistered, 1);
+    BFInstrumentationSendEvent(BFInstrumentationEventTypeContinuationRegistered,
+                               BFClockNowNanoseconds(),
+                               task,
+                               dependentTask,
+                               executor,
+                               (uintptr_t)(__bridge void *)dependentTask);
+}
+
+dispatch_block_t BFInstrumentationContinuationScheduled(BFTask *task,
+                                                        BFTask *dependentTask,
+                                                        BFExecutor *executor,
+                                                        dispatch_block_t block) {
+    uint64_t scheduledTimestamp = BFClockNowNanoseconds();
+    uintptr_t continuation = (uintptr_t)(__bridge void *)dependentTask;
+    BFInstrumentationCounterAdd(&BFInstrumentationContinuationsScheduled, 1);
+    BFExecutorCountScheduledContinuation(executor);
+    BFInstrumentationSendEvent(BFInstrumentationEventTypeContinuationScheduled,
+                               scheduledTimestamp,
+                               task,
+                               nil,
+                               executor,
+                               continuation);
+
+    // The wrapper keeps the task and the executor alive until the continuation ran, which the continuation block
+    // does anyway for the task.
+    return ^{
+        uint64_t startedTimestamp = BFClockNowNanoseconds();
+        BFInstrumentationCounterAdd(&BFInstrumentationContinuationsStarted, 1);
+        BFInstrumentationCounterAdd(&BFInstrumentationContinuationStartLatency, startedTimestamp - scheduledTimestamp);
+        BFExecutorCountStartedContinuation(executor);
+        BFInstrumentationSendEvent(BFInstrumentationEventTypeContinuationStarted,
+                                   startedTimestamp,
+                                   task,
+                                   nil,
+                                   executor,
+                                   continuation);
+
+        block();
+
+        BFInstrumentationCounterAdd(&BFInstrumentationContinuationsFinished, 1);
+        BFInstrumentationSendEvent(BFInstrumentationEventTypeContinuationFinished,
+                                   BFClockNowNanoseconds(),
+                                   task,
+                                   nil,
+                                   executor,
+                                   continuation);
+    };
+}
+
+void BFInstrumentationContinuationRunInline(BFTask *task,
+                                            BFExecutor *executor,
+                                            uintptr_t continuation,
+                                            void (*function)(void *context),
+                                            void *context) {
+    uint64_t startedTimestamp = BFClockNowNanoseconds();
+    BFInstrumentationCounterAdd(&BFInstrumentationContinuationsRegistered, 1);
+    BFInstrumentationCounterAdd(&BFInstrumentationContinuationsScheduled, 1);
+    BFInstrumentationCounterAdd(&BFInstrumentationContinuationsStarted, 1);
+    BFInstrumentationSendEvent(BFInstrumentationEventTypeContinuationRegistered,
+                               startedTimestamp,
+                               task,
+                               nil,
+                               executor,
+                               continuation);
+    BFInstrumentationSendEvent(BFInstrumentationEventTypeContinuationScheduled,
+                               startedTimestamp,
+                               task,
+                               nil,
+                               executor,
+                               continuation);
+    BFInstrumentationSendEvent(BFInstrumentationEventTypeContinuationStarted,
+                               startedTimestamp,
+                               task,
+                               nil,
+                               executor,
+                               continuation);
+
+    function(context);
+
+    BFInstrumentationCounterAdd(&BFInstrumentationContinuationsFinished, 1);
+    BFInstrumentationSendEvent(BFInstrumentationEventTypeContinuationFinished,
+                               BFClockNowNanoseconds(),
+                               task,
+                               nil,
+                               executor,
+                               continuation);
+}
+
+@implementation BFInstrumentation
+
+#pragma mark - Configuration
+
++ (BOOL)isEnabled {
+    return BFInstrumentationIsEnabled();
+}
+
++ (void)setEnabled:(BOOL)enabled {
+#if BF_INSTRUMENTATION
+    atomic_store_explicit(&BFInstrumentationEnabledFlag, enabled, memory_order_relaxed);
+#endif
+}
+
++ (nullable BFInstrumentationEventObserver)eventObserver {
+    return atomic_load_explicit(&BFInstrumentationCurrentEventObserver, memory_order_acquire);
+}
+
++ (void)setEventObserver:(nullable BFInstrumentationEventObserver)eventObserver {
+    atomic_store_explicit(&BFInstrumentationCurrentEventObserver, eventObserver, memory_order_release);
+}
+
+#pragma mark - Counters
+
++ (BFInstrumentationCounters)counters {
+    return (BFInstrumentationCounters){
+        .tasksCreated = BFInstrumentationCounterLoad(&BFInstrumentationTasksCreated),
+        .tasksCompleted = BFInstrumentationCounterLoad(&BFInstrumentationTasksCompleted),
+        .tasksDeallocated = BFInstrumentationCounterLoad(&BFInstrumentationTasksDeallocated),
+        .continuationsRegistered = BFInstrumentationCounterLoad(&BFInstrumentationContinuationsRegistered),
+        .continuationsScheduled = BFInstrumentationCounterLoad(&BFInstrumentationContinuationsScheduled),
+        .continuationsStarted = BFInstrumentationCounterLoad(&BFInstrumentationContinuationsStarted),
+        .continuationsFinished = BFInstrumentationCounterLoad(&BFInstrumentationContinuationsFinished),
+        .continuationStartLatencyNanoseconds = BFInstrumentationCounterLoad(&BFInstrumentationContinuationStartLatency),
+    };
+}
+
++ (uint64_t)queuedContinuationCountForExecutor:(BFExecutor *)executor {
+    return BFExecutorQueuedContinuationCount(executor);
+}
+
++ (void)resetCounters {
+    BFInstrumentationCounter *counters[] = {
+        &BFInstrumentationTasksCreated,
+        &BFInstrumentationTasksCompleted,
+        &BFInstrumentationTasksDeallocated,
+        &BFInstrumentationContinuationsRegistered,
+        &BFInstrumentationContinuationsScheduled,
+        &BFInstrumentationContinuationsStarted,
+        &BFInstrumentationContinuationsFinished,
+        &BFInstrumentationContinuationStartLatency,
+    };
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        atomic_store_explicit(&counters[i]->value, 0, memory_order_relaxed);
+    }
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class BFExecutor;
+
+/*!
+ Runs blocks in a fixed number of serial lanes, picking the lane of each block by a key.
+ Blocks submitted with equal keys (by `isEqual:` and `hash`) always share a lane, so they run one at a time and in
+ submission order, while different keys are spread across lanes that run in parallel.
+
+ Lanes are not threads or queues of their own: a lane with pending blocks is drained by a single block submitted to
+ the underlying executor, which runs a batch of them and yields the thread before running more,
+ so many lanes can share a thread pool fairly.
+ */
+@interface BFKeyedExecutor : NSObject
+
+/*!
+ Creates an executor whose lanes are drained on `+[BFExecutor threadPoolExecutor]`.
+ @param laneCount The number of lanes, must be greater than `0`.
+ */
++ (instancetype)keyedExecutorWithLaneCount:(NSUInteger)laneCount;
+
+/*!
+ Creates an executor whose lanes are drained on the given executor, which should run blocks concurrently.
+ @param laneCount The number of lanes, must be greater than `0`.
+ @param executor The executor to drain the lanes on.
+ */
++ (instancetype)keyedExecutorWithLaneCount:(NSUInteger)laneCount executor:(BFExecutor *)executor;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+/*!
+ The number of lanes.
+ */
+@property (nonatomic, assign, readonly) NSUInteger laneCount;
+
+/*!
+ Returns the executor of the lane of the given key, to use as the executor of continuations.
+ Equal keys get the same executor.
+ @param key The key to pick the lane with.
+ */
+- (BFExecutor *)executorForKey:(id)key;
+
+/*!
+ Runs the block in the lane of the given key, after the blocks submitted before it with an equal key.
+ @param block The block to run.
+ @param key The key to pick the lane with.
+ */
+- (void)execute:(void(^)(void))block forKey:(id)key;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,180 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import "BFKeyedExecutor.h"
+
+#import <pthread.h>
+
+#import "BFExecutor.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*!
+ Number of blocks a lane runs before it yields its thread to the other blocks of the underlying executor.
+ */
+static const NSUInteger BFKeyedExecutorLaneBatchSize = 64;
+
+/*!
+ A FIFO of blocks, run one at a time by at most one drain block on the underlying executor.
+ */
+@interface BFKeyedExecutorLane : NSObject
+
+- (instancetype)initWithExecutor:(BFExecutor *)executor;
+
+- (void)enqueueBlock:(dispatch_block_t)block;
+
+@end
+
+@implementation BFKeyedExecutorLane {
+    BFExecutor *_executor;
+
+    // Guarded by the lock.
+    pthread_mutex_t _lock;
+    NSMutableArray<dispatch_block_t> *_blocks;
+    BOOL _draining;
+}
+
+- (instancetype)initWithExecutor:(BFExecutor *)executor {
+    self = [super init];
+    if (!self) return self;
+
+    _executor = executor;
+    pthread_mutex_init(&_lock, NULL);
+    _blocks = [NSMutableArray array];
+
+    return self;
+}
+
+- (void)dealloc {
+    pthread_mutex_destroy(&_lock);
+}
+
+- (void)enqueueBlock:(dispatch_block_t)block {
+    pthread_mutex_lock(&_lock);
+    [_blocks addObject:[block copy]];
+    BOOL needsDrain = !_draining;
+    _draining = YES;
+    pthread_mutex_unlock(&_lock);
+
+    if (needsDrain) {
+        [self scheduleDrain];
+    }
+}
+
+- (void)scheduleDrain {
+    [_executor execute:^{
+        [self drain];
+    }];
+}
+
+- (void)drain {
+    NSUInteger budget = BFKeyedExecutorLaneBatchSize;
+    for (;;) {
+        // Take as many pending blocks as the budget allows at once, they are run in order without the lock.
+        // The rest stay at the front of the lane, for the rescheduled drain block.
+        pthread_mutex_lock(&_lock);
+        if (_blocks.count == 0) {
+            _draining = NO;
+            pthread_mutex_unlock(&_lock);
+            return;
+        }
+        if (budget == 0) {
+            pthread_mutex_unlock(&_lock);
+            // Still draining, so no other drain block can start before this one is rescheduled.
+            [self scheduleDrain];
+            return;
+        }
+        NSArray<dispatch_block_t> *blocks = nil;
+        if (_blocks.count <= budget) {
+            blocks = _blocks;
+            _blocks = [NSMutableArray array];
+        } else {
+            NSRange range = NSMakeRange(0, budget);
+            blocks = [_blocks subarrayWithRange:range];
+            [_blocks removeObjectsInRange:range];
+        }
+        pthread_mutex_unlock(&_lock);
+
+        for (dispatch_block_t block in blocks) {
+            @autoreleasepool {
+                block();
+            }
+        }
+        budget -= blocks.count;
+    }
+}
+
+@end
+
+/*!
+ Spreads the hash of a key over the lanes, so that keys with sequential hashes, like small numbers, don't cluster.
+ */
+static NSUInteger BFKeyedExecutorLaneIndex(NSUInteger hash, NSUInteger laneCount) {
+    uint64_t mixed = (uint64_t)hash * 0x9E3779B97F4A7C15ULL;
+    return (NSUInteger)((mixed ^ (mixed >> 32)) % laneCount);
+}
+
+@implementation BFKeyedExecutor {
+    NSArray<BFKeyedExecutorLane *> *_lanes;
+    NSArray<BFExecutor *> *_laneExecutors;
+}
+
+#pragma mark - Initializer
+
++ (instancetype)keyedExecutorWithLaneCount:(NSUInteger)laneCount {
+    return [self keyedExecutorWithLaneCount:laneCount executor:[BFExecutor threadPoolExecutor]];
+}
+
++ (instancetype)keyedExecutorWithLaneCount:(NSUInteger)laneCount executor:(BFExecutor *)executor {
+    return [[self alloc] initWithLaneCount:laneCount executor:executor];
+}
+
+- (instancetype)initWithLaneCount:(NSUInteger)laneCount executor:(BFExecutor *)executor {
+    self = [super init];
+    if (!self) return self;
+
+    if (laneCount == 0) {
+        [NSException raise:NSInvalidArgumentException format:@"A keyed executor needs at least one lane."];
+    }
+
+    NSMutableArray<BFKeyedExecutorLane *> *lanes = [NSMutableArray arrayWithCapacity:laneCount];
+    NSMutableArray<BFExecutor *> *laneExecutors = [NSMutableArray arrayWithCapacity:laneCount];
+    for (NSUInteger i = 0; i < laneCount; i++) {
+        BFKeyedExecutorLane *lane = [[BFKeyedExecutorLane alloc] initWithExecutor:executor];
+        [lanes addObject:lane];
+        [laneExecutors addObject:[BFExecutor executorWithBlock:^void(void(^block)(void)) {
+            [lane enqueueBlock:block];
+        }]];
+    }
+    _lanes = [lanes copy];
+    _laneExecutors = [laneExecutors copy];
+
+    return self;
+}
+
+#pragma mark - Lanes
+
+- (NSUInteger)laneCount {
+    return _lanes.count;
+}
+
+- (BFExecutor *)executorForKey:(id)key {
+    return _laneExecutors[BFKeyedExecutorLaneIndex([key hash], _lanes.count)];
+}
+
+#pragma mark - Execution
+
+- (void)execute:(void(^)(void))block forKey:(id)key {
+    [_lanes[BFKeyedExecutorLaneIndex([key hash], _lanes.count)] enqueueBlock:block];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
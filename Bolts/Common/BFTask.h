@@ -31,6 +31,12 @@ extern NSInteger const kBFMultipleErrorsError;
  */
 extern NSString *const BFTaskMultipleErrorsUserInfoKey;
 
+/*!
+ An error code used for <BFTask timeoutAfterDelay:>, if the task did not complete in time.
+ */
+extern NSInteger const kBFTimeoutError;
+
+@class BFCancellationTokenSource;
 @class BFExecutor;
 @class BFTask;
 
@@ -86,6 +92,16 @@ typedef __nullable id(^BFContinuationBlock)(BFTask<ResultType> *t);
  */
 + (instancetype)taskForCompletionOfAnyTask:(nullable NSArray<BFTask *> *)tasks;
 
+/*!
+ Returns a task that will be completed once there is at least one successful task.
+ The first task to successfully complete will set the result and cancel the given cancellation token source,
+ so that the remaining tasks can stop their work, and their results are ignored.
+ @param tasks An `NSArray` of the tasks to use as an input.
+ @param cancellationTokenSource The source of the token the input tasks observe, cancelled once the result is set.
+ */
++ (instancetype)taskForCompletionOfAnyTask:(nullable NSArray<BFTask *> *)tasks
+                   cancellationTokenSource:(nullable BFCancellationTokenSource *)cancellationTokenSource;
+
 /*!
  Returns a task that will be completed a certain amount of time in the future.
  @param millis The approximate number of milliseconds to wait before the
@@ -101,6 +117,14 @@ typedef __nullable id(^BFContinuationBlock)(BFTask<ResultType> *t);
  */
 + (BFTask<BFVoid> *)taskWithDelay:(int)millis cancellationToken:(nullable BFCancellationToken *)token;
 
+/*!
+ Returns a task that will be completed once the deadline has passed.
+ @param deadline The deadline, made with `dispatch_time()` for nanosecond delays on the monotonic clock,
+ or with `dispatch_walltime()`.
+ @param token The cancellation token (optional).
+ */
++ (BFTask<BFVoid> *)taskWithDeadline:(dispatch_time_t)deadline cancellationToken:(nullable BFCancellationToken *)token;
+
 /*!
  Returns a task that will be completed after the given block completes with
  the specified executor.
@@ -113,6 +137,26 @@ typedef __nullable id(^BFContinuationBlock)(BFTask<ResultType> *t);
  */
 + (instancetype)taskFromExecutor:(BFExecutor *)executor withBlock:(nullable id (^)(void))block;
 
+/*!
+ Returns a task that will be completed once the given block was run for every object, with at most
+ `maximumConcurrentCount` of the tasks returned by the block pending at any time.
+ Objects are started in order, and a new one is only started once a previous one has completed,
+ so that large collections can be processed with bounded concurrency and memory.
+ If all of them complete successfully the result will be an `NSArray` of their results in the order of the objects,
+ with `NSNull` in place of `nil` results.
+ Once one is faulted or cancelled no more objects are started, and the returned task is faulted or cancelled
+ as soon as the ones in flight have completed.
+ @param objects The objects to run the block with.
+ @param executor A BFExecutor responsible for determining how the block will be run.
+ @param maximumConcurrentCount The maximum number of objects in flight, must be > 0.
+ @param block The block to run with every object. It can return a BFTask, which then counts as in flight until
+ it is completed.
+ */
++ (BFTask<NSArray *> *)taskForMappingObjects:(nullable NSArray *)objects
+                                    executor:(BFExecutor *)executor
+                      maximumConcurrentCount:(NSUInteger)maximumConcurrentCount
+                                   withBlock:(id _Nullable (^)(id object))block;
+
 // Properties that will be set on the task once it is completed.
 
 /*!
@@ -143,9 +187,9 @@ typedef __nullable id(^BFContinuationBlock)(BFTask<ResultType> *t);
 /*!
  Enqueues the given block to be run once this task is complete.
  This method uses a default execution strategy. The block will be
- run on the thread where the previous task completes, unless the
- the stack depth is too deep, in which case it will be run on a
- dispatch queue with default priority.
+ run on the thread where the previous task completes. If continuations
+ are nested too deeply, the block is deferred until the outermost one
+ on that thread returns, instead of growing the stack further.
  @param block The block to be run once this task is complete.
  @returns A task that will be completed after block has run.
  If block returns a BFTask, then the task returned from
@@ -156,9 +200,9 @@ typedef __nullable id(^BFContinuationBlock)(BFTask<ResultType> *t);
 /*!
  Enqueues the given block to be run once this task is complete.
  This method uses a default execution strategy. The block will be
- run on the thread where the previous task completes, unless the
- the stack depth is too deep, in which case it will be run on a
- dispatch queue with default priority.
+ run on the thread where the previous task completes. If continuations
+ are nested too deeply, the block is deferred until the outermost one
+ on that thread returns, instead of growing the stack further.
  @param block The block to be run once this task is complete.
  @param cancellationToken The cancellation token (optional).
  @returns A task that will be completed after block has run.
@@ -185,7 +229,8 @@ typedef __nullable id(^BFContinuationBlock)(BFTask<ResultType> *t);
  @param executor A BFExecutor responsible for determining how the
  continuation block will be run.
  @param block The block to be run once this task is complete.
- @param cancellationToken The cancellation token (optional).
+ @param cancellationToken The cancellation token (optional). Cancelling it completes the returned task
+ as cancelled right away, and releases the block without waiting for this task to complete.
  @returns A task that will be completed after block has run.
  If block returns a BFTask, then the task returned from
  his method will not be completed until that task is completed.
@@ -253,14 +298,69 @@ NS_SWIFT_NAME(continueOnSuccessWith(block:cancellationToken:));
                cancellationToken:(nullable BFCancellationToken *)cancellationToken
 NS_SWIFT_NAME(continueOnSuccessWith(executor:block:cancellationToken:));
 
+/*!
+ Returns a task that completes like this task, or fails with a `kBFTimeoutError` error in `BFTaskErrorDomain`
+ if this task is not completed after the given amount of time.
+ The timer is released as soon as this task completes.
+ @param millis The approximate number of milliseconds to wait for this task.
+ */
+- (BFTask<ResultType> *)timeoutAfterDelay:(int)millis NS_SWIFT_NAME(timeout(afterDelay:));
+
+/*!
+ Returns a task that completes like this task, or fails with a `kBFTimeoutError` error in `BFTaskErrorDomain`
+ if this task is not completed after the given amount of time.
+ The timer is released as soon as this task completes.
+ @param millis The approximate number of milliseconds to wait for this task.
+ @param cancellationTokenSource The source to cancel once the timeout fires (optional),
+ typically the one of the token that the work behind this task observes.
+ */
+- (BFTask<ResultType> *)timeoutAfterDelay:(int)millis
+                  cancellationTokenSource:(nullable BFCancellationTokenSource *)cancellationTokenSource
+NS_SWIFT_NAME(timeout(afterDelay:cancellationTokenSource:));
+
 /*!
  Waits until this operation is completed.
  This method is inefficient and consumes a thread resource while
  it's running. It should be avoided. This method logs a warning
  message if it is used on the main thread.
+ When called from a continuation nested deeply enough that the default executor deferred continuations on this thread,
+ it first runs those, in order and from within the call, until this operation is completed,
+ since it might depend on them. The other deferred continuations run once the outermost continuation returns.
  */
 - (void)waitUntilFinished;
 
+/*!
+ Waits until this operation is completed, or until the deadline has passed.
+ Like `waitUntilFinished`, this blocks a thread and should be avoided.
+ @param deadline The time to stop waiting at, or `DISPATCH_TIME_FOREVER`.
+ @returns `YES` if this task is completed, `NO` if the deadline passed first.
+ */
+- (BOOL)waitUntilFinishedBeforeDeadline:(dispatch_time_t)deadline;
+
+/*!
+ Waits until this operation is completed, or until the timeout has elapsed.
+ Like `waitUntilFinished`, this blocks a thread and should be avoided.
+ @param millis The number of milliseconds to wait for at most.
+ @returns `YES` if this task is completed, `NO` if the timeout elapsed first.
+ */
+- (BOOL)waitUntilFinishedWithTimeout:(int)millis;
+
+/*!
+ Waits until all of the given tasks are completed.
+ The thread blocks once for all of them, instead of once per task.
+ @param tasks An `NSArray` of the tasks to wait for.
+ */
++ (void)waitUntilAllTasksFinished:(nullable NSArray<BFTask *> *)tasks;
+
+/*!
+ Waits until all of the given tasks are completed, or until the deadline has passed.
+ The thread blocks once for all of them, instead of once per task.
+ @param tasks An `NSArray` of the tasks to wait for.
+ @param deadline The time to stop waiting at, or `DISPATCH_TIME_FOREVER`.
+ @returns `YES` if all of the tasks are completed, `NO` if the deadline passed first.
+ */
++ (BOOL)waitUntilAllTasksFinished:(nullable NSArray<BFTask *> *)tasks deadline:(dispatch_time_t)deadline;
+
 @end
 
 NS_ASSUME_NONNULL_END
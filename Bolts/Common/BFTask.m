@@ -10,8 +10,13 @@
 
 #import "BFTask.h"
 
-#import <libkern/OSAtomic.h>
+#import <sched.h>
 
+#import "BFAtomics.h"
+#import "BFClock.h"
+#import "BFExecutor_Internal.h"
+#import "BFInstrumentation_Internal.h"
+#import "BFTimerWheel.h"
 #import "Bolts.h"
 
 NS_ASSUME_NONNULL_BEGIN
@@ -23,24 +28,698 @@ __attribute__ ((noinline)) void warnBlockingOperationOnMainThread() {
 
 NSString *const BFTaskErrorDomain = @"bolts";
 NSInteger const kBFMultipleErrorsError = 80175001;
+NSInteger const kBFTimeoutError = 80175002;
 
 NSString *const BFTaskMultipleErrorsUserInfoKey = @"errors";
 
+/*!
+ A node in the lock-free list of continuations of a pending task.
+ Nodes are pushed onto the head of the list, so the list is in reverse registration order.
+
+ A node is either a completion hook, or a continuation that holds everything needed to run it,
+ so that registering a continuation takes this one fixed-size record rather than a block capturing the same objects.
+ */
+typedef struct BFTaskContinuation {
+    struct BFTaskContinuation *_Nullable next;
+    /// The retained `BFExecutor` to run the continuation with, or `NULL` for a completion hook.
+    CFTypeRef _Nullable executor;
+    /// The retained `BFContinuationBlock` of a continuation, or `NULL` for one that forwards the outcome of the task
+    /// to the dependent task. The `BFTaskCompletionHook` to call for a completion hook.
+    CFTypeRef _Nullable block;
+    /// The retained task that the continuation completes, `NULL` for a completion hook.
+    CFTypeRef _Nullable dependentTask;
+    /// The retained `BFCancellationToken` of the continuation, if any.
+    CFTypeRef _Nullable cancellationToken;
+    /// The retained task the continuation was registered on, once it was moved to the task that one is linked to.
+    /// `NULL` while it is still on the list of the task it was registered on.
+    CFTypeRef _Nullable antecedent;
+    /// The context passed to a completion hook.
+    NSUInteger context;
+} BFTaskContinuation;
+
+/*!
+ The arguments of a continuation, which can live on the stack while the continuation runs.
+ */
+typedef struct BFTaskContinuationInvocation {
+    __unsafe_unretained BFTask *task;
+    __unsafe_unretained BFContinuationBlock _Nullable block;
+    /// The task to complete with the outcome of the continuation, or `nil` to return a task in `resultTask` instead.
+    __unsafe_unretained BFTask *_Nullable dependentTask;
+    __unsafe_unretained BFCancellationToken *_Nullable cancellationToken;
+    /// The executor that runs the continuation, only needed to report it to the instrumentation.
+    __unsafe_unretained BFExecutor *_Nullable executor;
+    /// The retained task with the outcome of the continuation, set when there is no dependent task.
+    CFTypeRef _Nullable resultTask;
+} BFTaskContinuationInvocation;
+
+/*!
+ A lightweight internal continuation, called on the completing thread with the completed task,
+ without creating a dependent task.
+ */
+typedef void(^BFTaskCompletionHook)(BFTask *task, NSUInteger context);
+
+/*
+ The whole state of a task lives in a single word.
+ While the task is pending, the word holds the head of the list of continuations (or `NULL`), optionally tagged with
+ `BFTaskStateCompletingBit` once a completer has claimed the task and is publishing the result,
+ and with `BFTaskStateDetachingBit` while a completion hook is being unlinked from the list.
+ Otherwise the word holds one of the codes below, which all have `BFTaskStateCodeBit` set and keep the other two tag bits
+ clear, so a code never reads as a tagged list, nor as a list with a flag set.
+
+ A pending task created for a continuation can also be linked to another task, with which it shares its outcome
+ from then on: the word then holds `BFTaskStateLinked` and the value holds the other task, and neither changes again.
+ The outcome and the continuations live in the root, the task at the end of the links, which is the only one that is
+ ever completed.
+ */
+static const uintptr_t BFTaskStateCompletingBit = 0x1;
+static const uintptr_t BFTaskStateCodeBit = 0x2;
+static const uintptr_t BFTaskStateDetachingBit = 0x4;
+static const uintptr_t BFTaskStatePendingFlags = BFTaskStateCompletingBit | BFTaskStateDetachingBit;
+static const uintptr_t BFTaskStateTagMask = BFTaskStatePendingFlags | BFTaskStateCodeBit;
+
+// Nodes come from `calloc`, which aligns them for any type, so the three tag bits of a node pointer are always clear.
+_Static_assert(__BIGGEST_ALIGNMENT__ >= 8, "Continuation nodes need three clear low bits for the tags.");
+
+/// While the value is being set to the task this task is linked to, for an instant.
+static const uintptr_t BFTaskStateLinking = (0 << 3) | BFTaskStateCodeBit;
+static const uintptr_t BFTaskStateLinked = (1 << 3) | BFTaskStateCodeBit;
+/// The final states, which are the codes from `BFTaskStateResult` on.
+static const uintptr_t BFTaskStateResult = (2 << 3) | BFTaskStateCodeBit;
+static const uintptr_t BFTaskStateError = (3 << 3) | BFTaskStateCodeBit;
+static const uintptr_t BFTaskStateCancelled = (4 << 3) | BFTaskStateCodeBit;
+
+static inline BOOL BFTaskStateIsPending(uintptr_t state) {
+    return (state & BFTaskStateCodeBit) == 0;
+}
+
+static inline BOOL BFTaskStateIsCompleted(uintptr_t state) {
+    return !BFTaskStateIsPending(state) && state >= BFTaskStateResult;
+}
+
+static inline BFTaskContinuation *_Nullable BFTaskContinuationsFromState(uintptr_t state) {
+    return (BFTaskContinuation *)(state & ~BFTaskStatePendingFlags);
+}
+
+/*!
+ The continuation that `removeContinuationWithIdentity:context:` finds a node by.
+ */
+static inline CFTypeRef _Nullable BFTaskContinuationIdentity(BFTaskContinuation *continuation) {
+    if (!continuation->block && continuation->executor) {
+        // Forwarding the outcome of a returned task is never removed, and may target the root of a dependent task
+        // that another continuation is registered for.
+        return NULL;
+    }
+    return continuation->dependentTask ?: continuation->block;
+}
+
+static void BFTaskReleaseContinuations(BFTaskContinuation *_Nullable continuation) {
+    while (continuation) {
+        BFTaskContinuation *next = continuation->next;
+        CFTypeRef references[] = {
+            continuation->executor,
+            continuation->block,
+            continuation->dependentTask,
+            continuation->cancellationToken,
+            continuation->antecedent,
+        };
+        for (size_t i = 0; i < sizeof(references) / sizeof(references[0]); i++) {
+            if (references[i]) {
+                CFRelease(references[i]);
+            }
+        }
+        free(continuation);
+        continuation = next;
+    }
+}
+
+typedef NS_OPTIONS(uint8_t, BFTaskFlags) {
+    // The creation of the task was counted by the instrumentation, so its deallocation is counted too,
+    // whether instrumentation is still enabled by then or not.
+    BFTaskFlagCounted = 1 << 0,
+    // The task was created for a continuation, and nobody but the framework ever completes it, so a continuation that
+    // returns it may link it rather than forward its outcome, see `linkToTask:`.
+    BFTaskFlagLinkable = 1 << 1,
+};
+
 @interface BFTask () {
-    id _result;
-    NSError *_error;
+    // Holds the result or the error, depending on the final state, or the task this one is linked to.
+    id _value;
+    atomic_uintptr_t _state;
+    // `BFTaskFlags`, only written while the task is initialized.
+    uint8_t _flags;
+}
+
+/*!
+ Creates a pending task for the outcome of a continuation.
+ */
+- (instancetype)initForContinuation;
+
+- (BOOL)trySetResult:(nullable id)result;
+- (BOOL)trySetError:(NSError *)error;
+- (BOOL)trySetCancelled;
+
+- (void)addCompletionHook:(BFTaskCompletionHook)hook context:(NSUInteger)context;
+- (BOOL)removeCompletionHook:(BFTaskCompletionHook)hook context:(NSUInteger)context;
+- (BOOL)removeContinuationWithIdentity:(id)identity context:(NSUInteger)context;
+- (void)forwardToTask:(BFTask *)dependentTask cancellationToken:(nullable BFCancellationToken *)cancellationToken;
+- (void)linkToTask:(BFTask *)dependentTask;
+- (void)runContinuations:(nullable BFTaskContinuation *)continuations;
+
+@end
+
+/*!
+ Completes the dependent task with the outcome of the completed task, or cancels it if cancellation was requested.
+ */
+static void BFTaskForwardOutcome(BFTask *task, BFTask *dependentTask, BFCancellationToken *_Nullable cancellationToken) {
+    if (cancellationToken.cancellationRequested || task.cancelled) {
+        [dependentTask trySetCancelled];
+    } else if (task.faulted) {
+        [dependentTask trySetError:task.error];
+    } else {
+        [dependentTask trySetResult:task.result];
+    }
+}
+
+/*!
+ Runs a continuation, with a `BFTaskContinuationInvocation` as the context.
+ Without a dependent task, a block that returns anything but a task has its outcome returned as a shared or
+ already completed task whenever possible, so that a continuation of a completed task on the immediate executor
+ allocates nothing but what its block does. A returned task always gets a new dependent task, the caller never gets
+ the returned task itself.
+ */
+static void BFTaskInvokeContinuation(void *context) {
+    BFTaskContinuationInvocation *invocation = context;
+    BFTask *dependentTask = invocation->dependentTask;
+    BFCancellationToken *cancellationToken = invocation->cancellationToken;
+
+    if (!invocation->block) {
+        BFTaskForwardOutcome(invocation->task, dependentTask, cancellationToken);
+        return;
+    }
+
+    if (cancellationToken.cancellationRequested) {
+        if (dependentTask) {
+            [dependentTask trySetCancelled];
+        } else {
+            invocation->resultTask = CFBridgingRetain([BFTask cancelledTask]);
+        }
+        return;
+    }
+
+    id result = invocation->block(invocation->task);
+    if (![result isKindOfClass:[BFTask class]]) {
+        if (dependentTask) {
+            [dependentTask trySetResult:result];
+        } else {
+            invocation->resultTask = CFBridgingRetain([BFTask taskWithResult:result]);
+        }
+        return;
+    }
+
+    BFTask *resultTask = (BFTask *)result;
+    if (!dependentTask) {
+        dependentTask = [[BFTask alloc] initForContinuation];
+        invocation->resultTask = CFBridgingRetain(dependentTask);
+    }
+    if (resultTask.completed) {
+        BFTaskForwardOutcome(resultTask, dependentTask, cancellationToken);
+    } else if (cancellationToken) {
+        // The token may still cancel the dependent task alone, so its outcome can't be shared.
+        [resultTask forwardToTask:dependentTask cancellationToken:cancellationToken];
+    } else {
+        [resultTask linkToTask:dependentTask];
+    }
+}
+
+/*!
+ Returns a block that runs the continuation, for executors that can't run it inline.
+ */
+static dispatch_block_t BFTaskContinuationBlock(BFTask *task, BFTaskContinuation *continuation) {
+    BFContinuationBlock block = (__bridge BFContinuationBlock)continuation->block;
+    BFTask *dependentTask = (__bridge BFTask *)continuation->dependentTask;
+    BFCancellationToken *cancellationToken = (__bridge BFCancellationToken *)continuation->cancellationToken;
+    return ^{
+        BFTaskContinuationInvocation invocation = {
+            .task = task,
+            .block = block,
+            .dependentTask = dependentTask,
+            .cancellationToken = cancellationToken,
+        };
+        BFTaskInvokeContinuation(&invocation);
+    };
+}
+
+/*!
+ Runs a continuation like `BFTaskInvokeContinuation`, and reports it to the instrumentation.
+ Used when the executor runs it right away, so that continuations of completed tasks return the same tasks
+ whether instrumentation is enabled or not.
+ */
+static void BFTaskInvokeInstrumentedContinuation(void *context) {
+    BFTaskContinuationInvocation *invocation = context;
+    BFInstrumentationContinuationRunInline(invocation->task,
+                                           invocation->executor,
+                                           (uintptr_t)context,
+                                           BFTaskInvokeContinuation,
+                                           context);
+}
+
+/*!
+ Skips the success block of a continuation of a failed or cancelled task, giving the failure a completed task of
+ its own, like the outcome of any continuation that returns a task. Takes a `BFTaskContinuationInvocation`.
+ */
+static void BFTaskSkipSuccessBlock(void *context) {
+    BFTaskContinuationInvocation *invocation = context;
+    BFTask *task = invocation->task;
+    BFTask *resultTask = task.cancelled ? [[BFTask alloc] initCancelled] : [[BFTask alloc] initWithError:task.error];
+    invocation->resultTask = CFBridgingRetain(resultTask);
+}
+
+/*!
+ The state shared by the inputs of `taskForCompletionOfAllTasks:`.
+ Every input decrements a single counter on completion, and the last one completes the aggregated task.
+ */
+@interface BFTaskCompletionOfAllTasks : NSObject
+
+@property (nonatomic, strong, readonly) BFTaskCompletionSource *taskCompletionSource;
+
+- (instancetype)initWithTasks:(NSArray<BFTask *> *)tasks collectResults:(BOOL)collectResults;
+
+- (void)taskDidComplete:(BFTask *)task atIndex:(NSUInteger)index;
+
+@end
+
+@implementation BFTaskCompletionOfAllTasks {
+    NSArray<BFTask *> *_tasks;
+    // Pre-sized to the number of tasks and filled in place by index, only when collecting results.
+    __strong id *_results;
+    BFAtomicCounter _remainingCount;
+    BFAtomicCounter _faultedCount;
+    BFAtomicCounter _cancelledCount;
+}
+
+- (instancetype)initWithTasks:(NSArray<BFTask *> *)tasks collectResults:(BOOL)collectResults {
+    self = [super init];
+    if (!self) return self;
+
+    _tasks = [tasks copy];
+    _taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    if (collectResults) {
+        _results = (__strong id *)calloc(tasks.count, sizeof(id));
+    }
+    BFAtomicCounterInit(&_remainingCount, tasks.count);
+
+    return self;
+}
+
+- (void)dealloc {
+    if (_results) {
+        for (NSUInteger i = 0; i < _tasks.count; i++) {
+            _results[i] = nil;
+        }
+        free(_results);
+    }
+}
+
+- (void)taskDidComplete:(BFTask *)task atIndex:(NSUInteger)index {
+    if (task.faulted) {
+        BFAtomicCounterIncrement(&_faultedCount);
+    } else if (task.cancelled) {
+        BFAtomicCounterIncrement(&_cancelledCount);
+    } else if (_results) {
+        _results[index] = task.result ?: [NSNull null];
+    }
+
+    // The last input to complete observes every write made by the others.
+    if (BFAtomicCounterDecrementToZero(&_remainingCount)) {
+        [self complete];
+    }
+}
+
+- (void)complete {
+    if (BFAtomicCounterLoad(&_faultedCount) > 0) {
+        NSMutableArray<NSError *> *errors = [NSMutableArray array];
+        for (BFTask *task in _tasks) {
+            if (task.error) {
+                [errors addObject:task.error];
+            }
+        }
+        if (errors.count == 1) {
+            self.taskCompletionSource.error = errors.firstObject;
+        } else {
+            NSError *error = [NSError errorWithDomain:BFTaskErrorDomain
+                                                 code:kBFMultipleErrorsError
+                                             userInfo:@{ BFTaskMultipleErrorsUserInfoKey: errors }];
+            self.taskCompletionSource.error = error;
+        }
+    } else if (BFAtomicCounterLoad(&_cancelledCount) > 0) {
+        [self.taskCompletionSource cancel];
+    } else if (_results) {
+        self.taskCompletionSource.result = [NSArray arrayWithObjects:_results count:_tasks.count];
+    } else {
+        self.taskCompletionSource.result = nil;
+    }
+}
+
+@end
+
+/*!
+ The state shared by the inputs of `taskForCompletionOfAnyTask:`.
+ The first input to succeed completes the aggregated task, otherwise the last input to complete does.
+ */
+@interface BFTaskCompletionOfAnyTask : NSObject
+
+@property (nonatomic, strong, readonly) BFTaskCompletionSource *taskCompletionSource;
+
+- (instancetype)initWithTasks:(NSArray<BFTask *> *)tasks
+      cancellationTokenSource:(nullable BFCancellationTokenSource *)cancellationTokenSource;
+
+- (void)addCompletionHooks;
+
+@end
+
+@implementation BFTaskCompletionOfAnyTask {
+    NSArray<BFTask *> *_tasks;
+    BFCancellationTokenSource *_cancellationTokenSource;
+    // The hook added to every input, cleared once the aggregated task is completed to break the retain cycle.
+    BFTaskCompletionHook _hook;
+    BFAtomicCounter _remainingCount;
+    BFAtomicCounter _cancelledCount;
+    BFAtomicFlag _completed;
+}
+
+- (instancetype)initWithTasks:(NSArray<BFTask *> *)tasks
+      cancellationTokenSource:(nullable BFCancellationTokenSource *)cancellationTokenSource {
+    self = [super init];
+    if (!self) return self;
+
+    _tasks = [tasks copy];
+    _cancellationTokenSource = cancellationTokenSource;
+    _taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    BFAtomicCounterInit(&_remainingCount, tasks.count);
+
+    return self;
+}
+
+- (void)addCompletionHooks {
+    BFTaskCompletionHook hook = ^(BFTask *task, NSUInteger index) {
+        [self taskDidComplete:task atIndex:index];
+    };
+    @synchronized (self) {
+        _hook = hook;
+    }
+    NSUInteger index = 0;
+    for (BFTask *task in _tasks) {
+        // An input that is completed already might have won, don't attach to the losers then.
+        if (BFAtomicFlagIsSet(&_completed)) {
+            break;
+        }
+        [task addCompletionHook:hook context:index++];
+    }
 }
 
-@property (nonatomic, assign, readwrite, getter=isCancelled) BOOL cancelled;
-@property (nonatomic, assign, readwrite, getter=isFaulted) BOOL faulted;
-@property (nonatomic, assign, readwrite, getter=isCompleted) BOOL completed;
+- (void)taskDidComplete:(BFTask *)task atIndex:(NSUInteger)index {
+    if (task.cancelled) {
+        BFAtomicCounterIncrement(&_cancelledCount);
+    } else if (!task.faulted && BFAtomicFlagTrySet(&_completed)) {
+        self.taskCompletionSource.result = task.result;
+        [_cancellationTokenSource cancel];
+        [self detachCompletionHooksExceptAtIndex:index];
+        return;
+    }
+
+    if (BFAtomicCounterDecrementToZero(&_remainingCount) && BFAtomicFlagTrySet(&_completed)) {
+        [self complete];
+        @synchronized (self) {
+            _hook = nil;
+        }
+    }
+}
+
+/*!
+ Unlinks the hook from the inputs that are still pending, so that their continuation lists shrink right away
+ rather than once they complete.
+ */
+- (void)detachCompletionHooksExceptAtIndex:(NSUInteger)winnerIndex {
+    BFTaskCompletionHook hook = nil;
+    @synchronized (self) {
+        hook = _hook;
+        _hook = nil;
+    }
+    if (!hook) {
+        return;
+    }
+    [_tasks enumerateObjectsUsingBlock:^(BFTask *task, NSUInteger index, BOOL *stop) {
+        if (index != winnerIndex) {
+            [task removeCompletionHook:hook context:index];
+        }
+    }];
+}
+
+- (void)complete {
+    if (BFAtomicCounterLoad(&_cancelledCount) > 0) {
+        [self.taskCompletionSource cancel];
+        return;
+    }
+
+    NSMutableArray<NSError *> *errors = [NSMutableArray array];
+    for (BFTask *task in _tasks) {
+        if (task.error) {
+            [errors addObject:task.error];
+        }
+    }
+    if (errors.count == 1) {
+        self.taskCompletionSource.error = errors.firstObject;
+    } else {
+        NSError *error = [NSError errorWithDomain:BFTaskErrorDomain
+                                             code:kBFMultipleErrorsError
+                                         userInfo:@{ BFTaskMultipleErrorsUserInfoKey: errors }];
+        self.taskCompletionSource.error = error;
+    }
+}
+
+@end
+
+/*!
+ The state of `taskForMappingObjects:executor:maximumConcurrentCount:withBlock:`.
+ Up to `maximumConcurrentCount` lanes each run one object at a time, and take the next object once it is completed.
+ */
+@interface BFTaskMapping : NSObject
+
+@property (nonatomic, strong, readonly) BFTaskCompletionSource *taskCompletionSource;
+
+- (instancetype)initWithObjects:(NSArray *)objects
+                       executor:(BFExecutor *)executor
+                      laneCount:(NSUInteger)laneCount
+                          block:(id _Nullable (^)(id object))block;
+
+- (void)start;
+
+@end
+
+@implementation BFTaskMapping {
+    NSArray *_objects;
+    BFExecutor *_executor;
+    id _Nullable (^_block)(id object);
+    NSUInteger _laneCount;
+    // The hook added to the task of every object, cleared once all of the lanes ended to break the retain cycle.
+    BFTaskCompletionHook _hook;
+
+    // Pre-sized to the number of objects and filled in place by index.
+    __strong id *_results;
+    NSMutableArray<NSError *> *_errors;
+    BFAtomicCounter _nextIndex;
+    BFAtomicCounter _activeLaneCount;
+    BFAtomicFlag _failed;
+    BFAtomicFlag _cancelled;
+}
+
+- (instancetype)initWithObjects:(NSArray *)objects
+                       executor:(BFExecutor *)executor
+                      laneCount:(NSUInteger)laneCount
+                          block:(id _Nullable (^)(id object))block {
+    self = [super init];
+    if (!self) return self;
+
+    _objects = [objects copy];
+    _executor = executor;
+    _block = [block copy];
+    _laneCount = laneCount;
+    _taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    _results = (__strong id *)calloc(objects.count, sizeof(id));
+    _errors = [NSMutableArray array];
+    BFAtomicCounterInit(&_activeLaneCount, laneCount);
+
+    return self;
+}
+
+- (void)dealloc {
+    for (NSUInteger i = 0; i < _objects.count; i++) {
+        _results[i] = nil;
+    }
+    free(_results);
+}
+
+- (void)start {
+    // Every pending object keeps the mapping alive through the hook until it is completed.
+    BFTaskCompletionHook hook = ^(BFTask *task, NSUInteger index) {
+        [self taskDidComplete:task atIndex:index];
+        [self runLane];
+    };
+    _hook = hook;
+    for (NSUInteger i = 0; i < _laneCount; i++) {
+        [self runLane];
+    }
+}
+
+/*!
+ Runs objects on the current lane until one of them is still pending, or there are none left.
+ Objects that complete synchronously are picked up by this loop rather than recursively,
+ so the depth of the stack doesn't grow with the number of objects.
+ */
+- (void)runLane {
+    while (YES) {
+        NSUInteger index = atomic_fetch_add_explicit(&_nextIndex, 1, memory_order_relaxed);
+        if (index >= _objects.count || BFAtomicFlagIsSet(&_failed) || BFAtomicFlagIsSet(&_cancelled)) {
+            if (BFAtomicCounterDecrementToZero(&_activeLaneCount)) {
+                [self complete];
+            }
+            return;
+        }
+
+        id object = _objects[index];
+        id _Nullable (^block)(id object) = _block;
+        BFTask *task = [BFTask taskFromExecutor:_executor withBlock:^id {
+            return block(object);
+        }];
+        if (!task.completed) {
+            [task addCompletionHook:_hook context:index];
+            return;
+        }
+        [self taskDidComplete:task atIndex:index];
+    }
+}
+
+- (void)taskDidComplete:(BFTask *)task atIndex:(NSUInteger)index {
+    if (task.faulted) {
+        @synchronized (_errors) {
+            [_errors addObject:task.error];
+        }
+        BFAtomicFlagTrySet(&_failed);
+    } else if (task.cancelled) {
+        BFAtomicFlagTrySet(&_cancelled);
+    } else {
+        _results[index] = task.result ?: [NSNull null];
+    }
+}
 
-@property (nonatomic, strong) NSObject *lock;
-@property (nonatomic, strong) NSCondition *condition;
-@property (nonatomic, strong) NSMutableArray *callbacks;
+- (void)complete {
+    _hook = nil;
+
+    if (_errors.count == 1) {
+        self.taskCompletionSource.error = _errors.firstObject;
+    } else if (_errors.count > 1) {
+        NSError *error = [NSError errorWithDomain:BFTaskErrorDomain
+                                             code:kBFMultipleErrorsError
+                                         userInfo:@{ BFTaskMultipleErrorsUserInfoKey: [_errors copy] }];
+        self.taskCompletionSource.error = error;
+    } else if (BFAtomicFlagIsSet(&_cancelled)) {
+        [self.taskCompletionSource cancel];
+    } else {
+        self.taskCompletionSource.result = [NSArray arrayWithObjects:_results count:_objects.count];
+    }
+}
 
 @end
 
+/*!
+ A thread blocked until some tasks are completed.
+ The thread parks on a single semaphore, which the last of the tasks to complete signals,
+ so waiting for many tasks blocks and wakes the thread only once.
+ */
+@interface BFTaskWaiter : NSObject
+
+- (instancetype)initWithTaskCount:(NSUInteger)taskCount;
+
+- (void)taskDidComplete;
+- (BOOL)waitUntilDeadline:(dispatch_time_t)deadline;
+
+@end
+
+@implementation BFTaskWaiter {
+    dispatch_semaphore_t _semaphore;
+    BFAtomicCounter _remainingTaskCount;
+}
+
+- (instancetype)initWithTaskCount:(NSUInteger)taskCount {
+    self = [super init];
+    if (!self) return self;
+
+    _semaphore = dispatch_semaphore_create(0);
+    BFAtomicCounterInit(&_remainingTaskCount, taskCount);
+
+    return self;
+}
+
+- (void)taskDidComplete {
+    if (BFAtomicCounterDecrementToZero(&_remainingTaskCount)) {
+        dispatch_semaphore_signal(_semaphore);
+    }
+}
+
+- (BOOL)waitUntilDeadline:(dispatch_time_t)deadline {
+    return dispatch_semaphore_wait(_semaphore, deadline) == 0;
+}
+
+@end
+
+/*!
+ Blocks the current thread until all of the tasks are completed, or the deadline has passed.
+ @returns Whether all of the tasks are completed.
+ */
+static BOOL BFTaskAllTasksCompleted(void *context) {
+    for (BFTask *task in (__bridge NSArray<BFTask *> *)context) {
+        if (!task.completed) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+static BOOL BFTaskWaitUntilAllTasksFinished(NSArray<BFTask *> *tasks, dispatch_time_t deadline) {
+    NSIndexSet *pendingIndexes = [tasks indexesOfObjectsPassingTest:^BOOL(BFTask *task, NSUInteger index, BOOL *stop) {
+        return !task.completed;
+    }];
+    if (pendingIndexes.count == 0) {
+        return YES;
+    }
+
+    // The tasks might be waiting on continuations that the default executor deferred on this very thread.
+    // Run those in order, but only as far as the tasks need, the others are left to the outermost continuation.
+    BFExecutorDrainCurrentThreadTrampolineUntil(BFTaskAllTasksCompleted, (__bridge void *)tasks);
+
+    BFTaskWaiter *waiter = [[BFTaskWaiter alloc] initWithTaskCount:pendingIndexes.count];
+    BFTaskCompletionHook hook = ^(BFTask *task, NSUInteger context) {
+        [waiter taskDidComplete];
+    };
+    [pendingIndexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+        [tasks[index] addCompletionHook:hook context:index];
+    }];
+    if ([waiter waitUntilDeadline:deadline]) {
+        return YES;
+    }
+
+    // Don't leave the hooks behind on tasks that may never complete.
+    [pendingIndexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+        [tasks[index] removeCompletionHook:hook context:index];
+    }];
+    for (BFTask *task in tasks) {
+        if (!task.completed) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
 @implementation BFTask
 
 #pragma mark - Initializer
@@ -49,9 +728,19 @@ NSString *const BFTaskMultipleErrorsUserInfoKey = @"errors";
     self = [super init];
     if (!self) return self;
 
-    _lock = [[NSObject alloc] init];
-    _condition = [[NSCondition alloc] init];
-    _callbacks = [NSMutableArray array];
+    if (BFInstrumentationIsEnabled()) {
+        _flags |= BFTaskFlagCounted;
+        BFInstrumentationTaskCreated(self);
+    }
+
+    return self;
+}
+
+- (instancetype)initForContinuation {
+    self = [self init];
+    if (!self) return self;
+
+    _flags |= BFTaskFlagLinkable;
 
     return self;
 }
@@ -60,7 +749,13 @@ NSString *const BFTaskMultipleErrorsUserInfoKey = @"errors";
     self = [super init];
     if (!self) return self;
 
-    [self trySetResult:result];
+    _value = result;
+    atomic_init(&_state, BFTaskStateResult);
+
+    if (BFInstrumentationIsEnabled()) {
+        _flags |= BFTaskFlagCounted;
+        BFInstrumentationTaskCreated(self);
+    }
 
     return self;
 }
@@ -69,7 +764,13 @@ NSString *const BFTaskMultipleErrorsUserInfoKey = @"errors";
     self = [super init];
     if (!self) return self;
 
-    [self trySetError:error];
+    _value = error;
+    atomic_init(&_state, BFTaskStateError);
+
+    if (BFInstrumentationIsEnabled()) {
+        _flags |= BFTaskFlagCounted;
+        BFInstrumentationTaskCreated(self);
+    }
 
     return self;
 }
@@ -78,14 +779,95 @@ NSString *const BFTaskMultipleErrorsUserInfoKey = @"errors";
     self = [super init];
     if (!self) return self;
 
-    [self trySetCancelled];
+    atomic_init(&_state, BFTaskStateCancelled);
+
+    if (BFInstrumentationIsEnabled()) {
+        _flags |= BFTaskFlagCounted;
+        BFInstrumentationTaskCreated(self);
+    }
 
     return self;
 }
 
+- (void)dealloc {
+    if (_flags & BFTaskFlagCounted) {
+        BFInstrumentationTaskDeallocated();
+    }
+
+    // A task that is deallocated while still pending owns whatever continuations were registered on it.
+    // The task it is linked to, if any, is released with the value.
+    uintptr_t state = atomic_load_explicit(&_state, memory_order_acquire);
+    if (BFTaskStateIsPending(state)) {
+        BFTaskReleaseContinuations(BFTaskContinuationsFromState(state));
+    }
+}
+
+#pragma mark - Shared Completed Tasks
+
+/*!
+ Number of `int` results, starting at `0`, that have a shared completed task.
+ */
+static const int BFTaskSharedIntegerResultCount = 16;
+
+static BFTask *BFTaskSharedNilResultTask;
+static BFTask *BFTaskSharedYesResultTask;
+static BFTask *BFTaskSharedNoResultTask;
+static BFTask *BFTaskSharedIntegerResultTasks[BFTaskSharedIntegerResultCount];
+static BFTask *BFTaskSharedCancelledTask;
+
+static void BFTaskInitializeSharedTasks(void) {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        BFTaskSharedNilResultTask = [[BFTask alloc] initWithResult:nil];
+        BFTaskSharedYesResultTask = [[BFTask alloc] initWithResult:[NSNumber numberWithBool:YES]];
+        BFTaskSharedNoResultTask = [[BFTask alloc] initWithResult:[NSNumber numberWithBool:NO]];
+        for (int i = 0; i < BFTaskSharedIntegerResultCount; i++) {
+            BFTaskSharedIntegerResultTasks[i] = [[BFTask alloc] initWithResult:[NSNumber numberWithInt:i]];
+        }
+        BFTaskSharedCancelledTask = [[BFTask alloc] initCancelled];
+    });
+}
+
+/*!
+ Returns the shared, immutable task for the given result, if there is one.
+ Completed tasks never change, so handing out the same instance is indistinguishable from allocating a new one.
+ */
+static BFTask *_Nullable BFTaskSharedTaskWithResult(id _Nullable result) {
+    BFTaskInitializeSharedTasks();
+
+    if (result == nil) {
+        return BFTaskSharedNilResultTask;
+    }
+    if (![result isKindOfClass:[NSNumber class]]) {
+        return nil;
+    }
+    // Booleans are singletons, so identity is enough and keeps `@YES` from matching `@1`.
+    if (result == BFTaskSharedYesResultTask->_value) {
+        return BFTaskSharedYesResultTask;
+    }
+    if (result == BFTaskSharedNoResultTask->_value) {
+        return BFTaskSharedNoResultTask;
+    }
+    NSNumber *number = result;
+    if (strcmp(number.objCType, @encode(int)) == 0) {
+        int value = number.intValue;
+        if (value >= 0 && value < BFTaskSharedIntegerResultCount) {
+            return BFTaskSharedIntegerResultTasks[value];
+        }
+    }
+    return nil;
+}
+
 #pragma mark - Task Class methods
 
 + (instancetype)taskWithResult:(nullable id)result {
+    // Subclasses always get instances of their own class.
+    if (self == [BFTask class]) {
+        BFTask *task = BFTaskSharedTaskWithResult(result);
+        if (task) {
+            return task;
+        }
+    }
     return [[self alloc] initWithResult:result];
 }
 
@@ -94,132 +876,124 @@ NSString *const BFTaskMultipleErrorsUserInfoKey = @"errors";
 }
 
 + (instancetype)cancelledTask {
+    if (self == [BFTask class]) {
+        BFTaskInitializeSharedTasks();
+        return BFTaskSharedCancelledTask;
+    }
     return [[self alloc] initCancelled];
 }
 
 + (instancetype)taskForCompletionOfAllTasks:(nullable NSArray<BFTask *> *)tasks {
-    __block int32_t total = (int32_t)tasks.count;
-    if (total == 0) {
-        return [self taskWithResult:nil];
-    }
+    return [self taskForCompletionOfAllTasks:tasks collectResults:NO];
+}
 
-    __block int32_t cancelled = 0;
-    NSObject *lock = [[NSObject alloc] init];
-    NSMutableArray *errors = [NSMutableArray array];
++ (instancetype)taskForCompletionOfAllTasksWithResults:(nullable NSArray<BFTask *> *)tasks {
+    return [self taskForCompletionOfAllTasks:tasks collectResults:YES];
+}
 
-    BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
-    for (BFTask *task in tasks) {
-        [task continueWithBlock:^id(BFTask *t) {
-            if (t.error) {
-                @synchronized (lock) {
-                    [errors addObject:t.error];
-                }
-            } else if (t.cancelled) {
-                OSAtomicIncrement32Barrier(&cancelled);
-            }
++ (instancetype)taskForCompletionOfAllTasks:(nullable NSArray<BFTask *> *)tasks collectResults:(BOOL)collectResults {
+    if (tasks.count == 0) {
+        // Results of no tasks at all are an empty array, but there are none for a `nil` array, as there always were.
+        return [self taskWithResult:(collectResults && tasks ? @[] : nil)];
+    }
 
-            if (OSAtomicDecrement32Barrier(&total) == 0) {
-                if (errors.count > 0) {
-                    if (errors.count == 1) {
-                        tcs.error = [errors firstObject];
-                    } else {
-                        NSError *error = [NSError errorWithDomain:BFTaskErrorDomain
-                                                             code:kBFMultipleErrorsError
-                                                         userInfo:@{ BFTaskMultipleErrorsUserInfoKey: errors }];
-                        tcs.error = error;
-                    }
-                } else if (cancelled > 0) {
-                    [tcs cancel];
-                } else {
-                    tcs.result = nil;
-                }
-            }
-            return nil;
-        }];
+    BFTaskCompletionOfAllTasks *aggregation = [[BFTaskCompletionOfAllTasks alloc] initWithTasks:tasks
+                                                                                  collectResults:collectResults];
+    // A single hook is shared by all of the inputs, each input only costs a list node.
+    BFTaskCompletionHook hook = ^(BFTask *task, NSUInteger index) {
+        [aggregation taskDidComplete:task atIndex:index];
+    };
+    BFTaskCompletionSource *tcs = aggregation.taskCompletionSource;
+    NSUInteger index = 0;
+    for (BFTask *task in tasks) {
+        [task addCompletionHook:hook context:index++];
     }
     return tcs.task;
 }
 
-+ (instancetype)taskForCompletionOfAllTasksWithResults:(nullable NSArray<BFTask *> *)tasks {
-    return [[self taskForCompletionOfAllTasks:tasks] continueWithSuccessBlock:^id(BFTask * __unused task) {
-        return [tasks valueForKey:@"result"];
-    }];
++ (instancetype)taskForCompletionOfAnyTask:(nullable NSArray<BFTask *> *)tasks {
+    if (tasks.count == 0) {
+        return [self taskWithResult:nil];
+    }
+
+    return [self taskForCompletionOfAnyTask:tasks cancellationTokenSource:nil];
 }
 
 + (instancetype)taskForCompletionOfAnyTask:(nullable NSArray<BFTask *> *)tasks
-{
-    __block int32_t total = (int32_t)tasks.count;
-    if (total == 0) {
+                   cancellationTokenSource:(nullable BFCancellationTokenSource *)cancellationTokenSource {
+    if (tasks.count == 0) {
         return [self taskWithResult:nil];
     }
-    
-    __block int completed = 0;
-    __block int32_t cancelled = 0;
-    
-    NSObject *lock = [NSObject new];
-    NSMutableArray<NSError *> *errors = [NSMutableArray new];
-    
-    BFTaskCompletionSource *source = [BFTaskCompletionSource taskCompletionSource];
-    for (BFTask *task in tasks) {
-        [task continueWithBlock:^id(BFTask *t) {
-            if (t.error != nil) {
-                @synchronized(lock) {
-                    [errors addObject:t.error];
-                }
-            } else if (t.cancelled) {
-                OSAtomicIncrement32Barrier(&cancelled);
-            } else {
-                if(OSAtomicCompareAndSwap32Barrier(0, 1, &completed)) {
-                    [source setResult:t.result];
-                }
-            }
-            
-            if (OSAtomicDecrement32Barrier(&total) == 0 &&
-                OSAtomicCompareAndSwap32Barrier(0, 1, &completed)) {
-                if (cancelled > 0) {
-                    [source cancel];
-                } else if (errors.count > 0) {
-                    if (errors.count == 1) {
-                        source.error = errors.firstObject;
-                    } else {
-                        NSError *error = [NSError errorWithDomain:BFTaskErrorDomain
-                                                             code:kBFMultipleErrorsError
-                                                         userInfo:@{ @"errors": errors }];
-                        source.error = error;
-                    }
-                }
-            }
-            // Abort execution of per tasks continuations
-            return nil;
-        }];
-    }
-    return source.task;
+
+    BFTaskCompletionOfAnyTask *aggregation = [[BFTaskCompletionOfAnyTask alloc] initWithTasks:tasks
+                                                                      cancellationTokenSource:cancellationTokenSource];
+    BFTaskCompletionSource *tcs = aggregation.taskCompletionSource;
+    [aggregation addCompletionHooks];
+    return tcs.task;
 }
 
++ (BFTask<NSArray *> *)taskForMappingObjects:(nullable NSArray *)objects
+                                    executor:(BFExecutor *)executor
+                      maximumConcurrentCount:(NSUInteger)maximumConcurrentCount
+                                   withBlock:(id _Nullable (^)(id object))block {
+    if (maximumConcurrentCount == 0) {
+        [NSException raise:NSInvalidArgumentException format:@"Maximum concurrent count must be > 0"];
+    }
+    if (!block) {
+        [NSException raise:NSInvalidArgumentException format:@"A mapping needs a block to run for every object"];
+    }
+    if (objects.count == 0) {
+        return [BFTask taskWithResult:@[]];
+    }
 
-+ (BFTask<BFVoid> *)taskWithDelay:(int)millis {
-    BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
-    dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, millis * NSEC_PER_MSEC);
-    dispatch_after(popTime, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(void){
-        tcs.result = nil;
-    });
+    BFTaskMapping *mapping = [[BFTaskMapping alloc] initWithObjects:objects
+                                                           executor:executor
+                                                          laneCount:MIN(maximumConcurrentCount, objects.count)
+                                                              block:block];
+    BFTaskCompletionSource *tcs = mapping.taskCompletionSource;
+    [mapping start];
     return tcs.task;
 }
 
++ (BFTask<BFVoid> *)taskWithDelay:(int)millis {
+    return [self taskWithDelay:millis cancellationToken:nil];
+}
+
 + (BFTask<BFVoid> *)taskWithDelay:(int)millis cancellationToken:(nullable BFCancellationToken *)token {
+    return [self taskWithDeadline:dispatch_time(DISPATCH_TIME_NOW, (int64_t)millis * NSEC_PER_MSEC) cancellationToken:token];
+}
+
++ (BFTask<BFVoid> *)taskWithDeadline:(dispatch_time_t)deadline cancellationToken:(nullable BFCancellationToken *)token {
     if (token.cancellationRequested) {
         return [BFTask cancelledTask];
     }
 
     BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
-    dispatch_time_t popTime = dispatch_time(DISPATCH_TIME_NOW, millis * NSEC_PER_MSEC);
-    dispatch_after(popTime, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(void){
-        if (token.cancellationRequested) {
-            [tcs cancel];
-            return;
+    BFTimerWheel *timerWheel = [BFTimerWheel sharedTimerWheel];
+    BFTimerWheelEntry *entry = nil;
+    if (deadline != DISPATCH_TIME_FOREVER) {
+        entry = [timerWheel scheduleBlock:^{
+            [tcs trySetResult:nil];
+        } atDeadline:BFClockNanosecondsFromDispatchTime(deadline)];
+    }
+    if (!token) {
+        return tcs.task;
+    }
+
+    // Cancelling removes the delay from the wheel right away, rather than once it expires.
+    dispatch_block_t cancellationBlock = ^{
+        if (entry) {
+            [timerWheel cancelEntry:entry];
         }
-        tcs.result = nil;
-    });
+        [tcs trySetCancelled];
+    };
+    BFCancellationTokenRegistration *registration = [token registerCancellationObserverWithBlock:cancellationBlock];
+    [tcs.task addCompletionHook:^(BFTask *task, NSUInteger context) {
+        [registration dispose];
+    } context:0];
+    if (token.cancellationRequested) {
+        cancellationBlock();
+    }
     return tcs.task;
 }
 
@@ -231,82 +1005,445 @@ NSString *const BFTaskMultipleErrorsUserInfoKey = @"errors";
 
 #pragma mark - Custom Setters/Getters
 
-- (nullable id)result {
-    @synchronized(self.lock) {
-        return _result;
+/*!
+ Returns the root of the task, which holds its outcome: the task itself, unless it was linked to another task.
+ The links that lead to the root keep it alive as long as the task.
+ The state of the root may be `BFTaskStateLinking`, which is pending for every purpose but changing it.
+ */
+static inline BFTask *BFTaskLoadRootState(BFTask *task, uintptr_t *state) {
+    __unsafe_unretained BFTask *root = task;
+    uintptr_t rootState = atomic_load_explicit(&root->_state, memory_order_acquire);
+    while (rootState == BFTaskStateLinked) {
+        // The value of a linked task never changes, and was set before the state was.
+        root = root->_value;
+        rootState = atomic_load_explicit(&root->_state, memory_order_acquire);
     }
+    *state = rootState;
+    return root;
+}
+
+- (nullable id)result {
+    uintptr_t state = 0;
+    BFTask *root = BFTaskLoadRootState(self, &state);
+    return state == BFTaskStateResult ? root->_value : nil;
 }
 
 - (BOOL)trySetResult:(nullable id)result {
-    @synchronized(self.lock) {
-        if (self.completed) {
-            return NO;
-        }
-        self.completed = YES;
-        _result = result;
-        [self runContinuations];
-        return YES;
-    }
+    return [self trySetState:BFTaskStateResult value:result];
 }
 
 - (nullable NSError *)error {
-    @synchronized(self.lock) {
-        return _error;
-    }
+    uintptr_t state = 0;
+    BFTask *root = BFTaskLoadRootState(self, &state);
+    return state == BFTaskStateError ? root->_value : nil;
 }
 
 - (BOOL)trySetError:(NSError *)error {
-    @synchronized(self.lock) {
-        if (self.completed) {
+    return [self trySetState:BFTaskStateError value:error];
+}
+
+- (BOOL)isCancelled {
+    uintptr_t state = 0;
+    BFTaskLoadRootState(self, &state);
+    return state == BFTaskStateCancelled;
+}
+
+- (BOOL)isFaulted {
+    uintptr_t state = 0;
+    BFTaskLoadRootState(self, &state);
+    return state == BFTaskStateError;
+}
+
+- (BOOL)trySetCancelled {
+    return [self trySetState:BFTaskStateCancelled value:nil];
+}
+
+- (BOOL)isCompleted {
+    uintptr_t state = 0;
+    BFTaskLoadRootState(self, &state);
+    return BFTaskStateIsCompleted(state);
+}
+
+#pragma mark - State Machine
+
+- (BOOL)trySetState:(uintptr_t)completedState value:(nullable id)value {
+    // Claim the task, so that only one completer ever writes the value.
+    uintptr_t state = atomic_load_explicit(&_state, memory_order_acquire);
+    for (;;) {
+        if (state == BFTaskStateLinked) {
+            // The outcome is shared with the root, which is the one to complete.
+            uintptr_t rootState = 0;
+            return [BFTaskLoadRootState(self, &rootState) trySetState:completedState value:value];
+        }
+        if (state == BFTaskStateLinking) {
+            sched_yield();
+            state = atomic_load_explicit(&_state, memory_order_acquire);
+            continue;
+        }
+        if (!BFTaskStateIsPending(state) || (state & BFTaskStateCompletingBit)) {
             return NO;
         }
-        self.completed = YES;
-        self.faulted = YES;
-        _error = error;
-        [self runContinuations];
-        return YES;
+        if (atomic_compare_exchange_weak_explicit(&_state,
+                                                  &state,
+                                                  state | BFTaskStateCompletingBit,
+                                                  memory_order_acquire,
+                                                  memory_order_acquire)) {
+            break;
+        }
     }
+
+    _value = value;
+
+    // Publish the final state and take ownership of every continuation registered up to this point,
+    // once no completion hook is being unlinked from the list anymore.
+    // The task can't be linked meanwhile, it is claimed.
+    state = atomic_load_explicit(&_state, memory_order_relaxed);
+    while ((state & BFTaskStateDetachingBit) || !atomic_compare_exchange_weak(&_state, &state, completedState)) {
+        if (state & BFTaskStateDetachingBit) {
+            sched_yield();
+            state = atomic_load_explicit(&_state, memory_order_relaxed);
+        }
+    }
+
+    if (BFInstrumentationIsEnabled()) {
+        BFInstrumentationTaskCompleted(self);
+    }
+
+    [self runContinuations:BFTaskContinuationsFromState(state)];
+    return YES;
 }
 
-- (BOOL)isCancelled {
-    @synchronized(self.lock) {
-        return _cancelled;
+/*!
+ Pushes the continuation onto the list of this task.
+ @returns `NO` if the task is already completed, in which case the continuation is left to the caller.
+ */
+- (BOOL)addContinuation:(BFTaskContinuation *)continuation {
+    NSAssert(((uintptr_t)continuation & BFTaskStateTagMask) == 0, @"Continuation nodes must leave the tag bits clear.");
+
+    uintptr_t state = atomic_load_explicit(&_state, memory_order_acquire);
+    for (;;) {
+        if (state == BFTaskStateLinked) {
+            // The continuation is run by the root, but still with the task it was registered on.
+            if (!continuation->antecedent) {
+                continuation->antecedent = CFBridgingRetain(self);
+            }
+            uintptr_t rootState = 0;
+            return [BFTaskLoadRootState(self, &rootState) addContinuation:continuation];
+        }
+        if (state == BFTaskStateLinking) {
+            sched_yield();
+            state = atomic_load_explicit(&_state, memory_order_acquire);
+            continue;
+        }
+        if (BFTaskStateIsCompleted(state)) {
+            continuation->next = NULL;
+            return NO;
+        }
+        continuation->next = BFTaskContinuationsFromState(state);
+        if (atomic_compare_exchange_weak_explicit(&_state,
+                                                  &state,
+                                                  (uintptr_t)continuation | (state & BFTaskStatePendingFlags),
+                                                  memory_order_release,
+                                                  memory_order_acquire)) {
+            return YES;
+        }
     }
 }
 
-- (BOOL)isFaulted {
-    @synchronized(self.lock) {
-        return _faulted;
+/*!
+ Calls the hook with this task and the context once this task is completed,
+ right away if it is completed already.
+ */
+- (void)addCompletionHook:(BFTaskCompletionHook)hook context:(NSUInteger)context {
+    if (!self.completed) {
+        BFTaskContinuation *continuation = calloc(1, sizeof(BFTaskContinuation));
+        continuation->block = CFBridgingRetain([hook copy]);
+        continuation->context = context;
+        if ([self addContinuation:continuation]) {
+            return;
+        }
+        BFTaskReleaseContinuations(continuation);
     }
+    hook(self, context);
 }
 
-- (BOOL)trySetCancelled {
-    @synchronized(self.lock) {
-        if (self.completed) {
+/*!
+ Unlinks a completion hook that was added with `addCompletionHook:context:` and was not called yet.
+ @returns `YES` if the hook was unlinked, `NO` if this task completed already and the hook is called (or was called).
+ */
+- (BOOL)removeCompletionHook:(BFTaskCompletionHook)hook context:(NSUInteger)context {
+    return [self removeContinuationWithIdentity:hook context:context];
+}
+
+/*!
+ Unlinks a continuation before it is run, found by the task it completes, or by its block and context for a completion hook.
+ @returns `YES` if the continuation was unlinked, `NO` if this task completed already.
+ */
+- (BOOL)removeContinuationWithIdentity:(id)identity context:(NSUInteger)context {
+    return [self removeContinuationWithIdentity:identity context:context antecedent:NULL];
+}
+
+/*!
+ Unlinks a continuation from the list of this task, among the ones that were registered on the given task and moved
+ to this one, or among the ones registered on this task if `antecedent` is `NULL`.
+ */
+- (BOOL)removeContinuationWithIdentity:(id)identity context:(NSUInteger)context antecedent:(nullable CFTypeRef)antecedent {
+    // Lock the list against completion, linking and other removals. Pushes onto the head are still allowed meanwhile.
+    uintptr_t state = atomic_load_explicit(&_state, memory_order_acquire);
+    for (;;) {
+        if (state == BFTaskStateLinked) {
+            uintptr_t rootState = 0;
+            return [BFTaskLoadRootState(self, &rootState) removeContinuationWithIdentity:identity
+                                                                                 context:context
+                                                                              antecedent:antecedent ?: (__bridge CFTypeRef)self];
+        }
+        if (BFTaskStateIsCompleted(state)) {
             return NO;
         }
-        self.completed = YES;
-        self.cancelled = YES;
-        [self runContinuations];
-        return YES;
+        if (state == BFTaskStateLinking || (state & BFTaskStateDetachingBit)) {
+            sched_yield();
+            state = atomic_load_explicit(&_state, memory_order_acquire);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&_state,
+                                                  &state,
+                                                  state | BFTaskStateDetachingBit,
+                                                  memory_order_acquire,
+                                                  memory_order_acquire)) {
+            break;
+        }
+    }
+    state |= BFTaskStateDetachingBit;
+
+    BFTaskContinuation *removed = NULL;
+    while (!removed) {
+        BFTaskContinuation *previous = NULL;
+        BFTaskContinuation *continuation = BFTaskContinuationsFromState(state);
+        while (continuation && !(BFTaskContinuationIdentity(continuation) == (__bridge CFTypeRef)identity &&
+                                 continuation->context == context &&
+                                 continuation->antecedent == antecedent)) {
+            previous = continuation;
+            continuation = continuation->next;
+        }
+        if (!continuation) {
+            break;
+        }
+        if (previous) {
+            // Nodes past the head are only ever touched by the holder of the detaching bit.
+            previous->next = continuation->next;
+            removed = continuation;
+        } else if (atomic_compare_exchange_strong_explicit(&_state,
+                                                           &state,
+                                                           (uintptr_t)continuation->next | (state & BFTaskStatePendingFlags),
+                                                           memory_order_relaxed,
+                                                           memory_order_relaxed)) {
+            removed = continuation;
+        }
+        // Otherwise a continuation was pushed meanwhile, the node is not the head anymore.
+    }
+
+    atomic_fetch_and_explicit(&_state, ~BFTaskStateDetachingBit, memory_order_release);
+
+    if (removed) {
+        removed->next = NULL;
+        BFTaskReleaseContinuations(removed);
     }
+    return removed != NULL;
 }
 
-- (BOOL)isCompleted {
-    @synchronized(self.lock) {
-        return _completed;
+- (void)runContinuations:(nullable BFTaskContinuation *)continuations {
+    // The list was built by pushing onto its head, reverse it to run continuations in registration order.
+    BFTaskContinuation *continuation = NULL;
+    while (continuations) {
+        BFTaskContinuation *next = continuations->next;
+        continuations->next = continuation;
+        continuation = continuations;
+        continuations = next;
+    }
+
+    BOOL instrumented = BFInstrumentationIsEnabled();
+
+    // Every continuation that has to be submitted is grouped with the others on the same executor, in order,
+    // and each group goes to its executor as a single batch once all of them are collected.
+    BFExecutor *firstExecutor = nil;
+    dispatch_block_t firstBlock = nil;
+    NSMutableArray<BFExecutor *> *executors = nil;
+    NSMutableArray<NSMutableArray<dispatch_block_t> *> *batches = nil;
+    while (continuation) {
+        BFTaskContinuation *next = continuation->next;
+        continuation->next = NULL;
+
+        if (!continuation->executor) {
+            BFTaskCompletionHook hook = (BFTaskCompletionHook)CFBridgingRelease(continuation->block);
+            BFTask *antecedent = continuation->antecedent ? (BFTask *)CFBridgingRelease(continuation->antecedent) : self;
+            NSUInteger context = continuation->context;
+            free(continuation);
+            continuation = next;
+
+            hook(antecedent, context);
+            continue;
+        }
+
+        // Continuations that the executor would run right away are run from the record, without a block.
+        BFExecutor *executor = (__bridge BFExecutor *)continuation->executor;
+        if (!instrumented) {
+            BFTaskContinuationInvocation invocation = {
+                .task = continuation->antecedent ? (__bridge BFTask *)continuation->antecedent : self,
+                .block = (__bridge BFContinuationBlock)continuation->block,
+                .dependentTask = (__bridge BFTask *)continuation->dependentTask,
+                .cancellationToken = (__bridge BFCancellationToken *)continuation->cancellationToken,
+            };
+            if (BFExecutorTryRunInline(executor, BFTaskInvokeContinuation, &invocation)) {
+                BFTaskReleaseContinuations(continuation);
+                continuation = next;
+                continue;
+            }
+        }
+
+        dispatch_block_t block = [self blockForContinuation:continuation instrumented:instrumented];
+        continuation = next;
+
+        // A single continuation, by far the most common case, needs no grouping.
+        if (!firstBlock) {
+            firstExecutor = executor;
+            firstBlock = block;
+            continue;
+        }
+        if (!executors) {
+            executors = [NSMutableArray arrayWithObject:firstExecutor];
+            batches = [NSMutableArray arrayWithObject:[NSMutableArray arrayWithObject:firstBlock]];
+        }
+        NSUInteger index = [executors indexOfObjectIdenticalTo:executor];
+        if (index == NSNotFound) {
+            [executors addObject:executor];
+            [batches addObject:[NSMutableArray arrayWithObject:block]];
+        } else {
+            [batches[index] addObject:block];
+        }
+    }
+
+    if (!executors) {
+        if (firstBlock) {
+            [firstExecutor execute:firstBlock];
+        }
+        return;
+    }
+    for (NSUInteger i = 0; i < executors.count; i++) {
+        NSArray<dispatch_block_t> *batch = batches[i];
+        if (batch.count == 1) {
+            [executors[i] execute:batch.firstObject];
+        } else {
+            [executors[i] executeBlocks:batch];
+        }
     }
 }
 
-- (void)runContinuations {
-    @synchronized(self.lock) {
-        [self.condition lock];
-        [self.condition broadcast];
-        [self.condition unlock];
-        for (void (^callback)(void) in self.callbacks) {
-            callback();
+/*!
+ Releases the record of the continuation, and returns a block that runs it instead.
+ */
+- (dispatch_block_t)blockForContinuation:(BFTaskContinuation *)continuation instrumented:(BOOL)instrumented {
+    BFTask *antecedent = continuation->antecedent ? (__bridge BFTask *)continuation->antecedent : self;
+    dispatch_block_t block = BFTaskContinuationBlock(antecedent, continuation);
+    // Forwarding the outcome of a returned task is part of the continuation that returned it.
+    if (instrumented && continuation->block) {
+        block = BFInstrumentationContinuationScheduled(antecedent,
+                                                       (__bridge BFTask *)continuation->dependentTask,
+                                                       (__bridge BFExecutor *)continuation->executor,
+                                                       block);
+    }
+    BFTaskReleaseContinuations(continuation);
+    return block;
+}
+
+/*!
+ Completes the dependent task with the outcome of this task once it is completed,
+ or cancels it if cancellation was requested by then.
+ */
+- (void)forwardToTask:(BFTask *)dependentTask cancellationToken:(nullable BFCancellationToken *)cancellationToken {
+    // Forwarding runs on the default executor, so that long chains of returned tasks don't grow the stack.
+    // It completes the root of the dependent task, which is the same, and lets the tasks linked in between go.
+    uintptr_t dependentRootState = 0;
+    BFTask *dependentRoot = BFTaskLoadRootState(dependentTask, &dependentRootState);
+    BFTaskContinuation *continuation = calloc(1, sizeof(BFTaskContinuation));
+    continuation->executor = CFBridgingRetain([BFExecutor defaultExecutor]);
+    continuation->dependentTask = CFBridgingRetain(dependentRoot);
+    continuation->cancellationToken = cancellationToken ? CFBridgingRetain(cancellationToken) : NULL;
+    if (![self addContinuation:continuation]) {
+        [self runContinuations:continuation];
+    }
+}
+
+/*!
+ Makes the dependent task share the outcome of this pending task, rather than forwarding it.
+ Nothing else may complete the dependent task from then on, which holds for the task of a continuation that ran.
+
+ This task is linked to the root of the dependent task, and hands its continuations over.
+ When a continuation returns a task whose own continuation returns another task and so on, every returned task is linked
+ to the first dependent task, so however deep the recursion goes, the tasks in between are released as soon as they
+ were returned. Linking in that direction changes the state of the returned task, so only a task created for
+ a continuation, that was not linked yet, is ever linked: the task of a task completion source stays its own,
+ and gets its outcome forwarded instead, like any task returned from more than one continuation.
+ */
+- (void)linkToTask:(BFTask *)dependentTask {
+    uintptr_t dependentRootState = 0;
+    BFTask *dependentRoot = BFTaskLoadRootState(dependentTask, &dependentRootState);
+
+    for (;;) {
+        uintptr_t state = 0;
+        BFTask *root = BFTaskLoadRootState(self, &state);
+        if (root != self || !(_flags & BFTaskFlagLinkable)) {
+            if (BFTaskStateIsCompleted(state)) {
+                BFTaskForwardOutcome(root, dependentTask, nil);
+            } else if (root != dependentRoot) {
+                [root forwardToTask:dependentTask cancellationToken:nil];
+            }
+            return;
+        }
+        if (root == dependentRoot) {
+            // A task that depends on itself never completes, linking it to itself would not change that.
+            return;
+        }
+        if (BFTaskStateIsCompleted(state)) {
+            BFTaskForwardOutcome(root, dependentTask, nil);
+            return;
+        }
+        if (state & BFTaskStateCompletingBit) {
+            // The outcome is being published, forward it once it is.
+            [root forwardToTask:dependentTask cancellationToken:nil];
+            return;
+        }
+        if (state == BFTaskStateLinking || (state & BFTaskStateDetachingBit)) {
+            sched_yield();
+            continue;
+        }
+
+        // Take the continuations, and keep everything else off the root until its value holds the link.
+        if (!atomic_compare_exchange_strong(&root->_state, &state, BFTaskStateLinking)) {
+            continue;
         }
-        [self.callbacks removeAllObjects];
+        root->_value = dependentRoot;
+        atomic_store_explicit(&root->_state, BFTaskStateLinked, memory_order_release);
+
+        // Hand the continuations over in registration order, each still run with the task it was registered on.
+        BFTaskContinuation *continuations = BFTaskContinuationsFromState(state);
+        BFTaskContinuation *continuation = NULL;
+        while (continuations) {
+            BFTaskContinuation *next = continuations->next;
+            continuations->next = continuation;
+            continuation = continuations;
+            continuations = next;
+        }
+        while (continuation) {
+            BFTaskContinuation *next = continuation->next;
+            if (!continuation->antecedent) {
+                continuation->antecedent = CFBridgingRetain(root);
+            }
+            if (![dependentRoot addContinuation:continuation]) {
+                [dependentRoot runContinuations:continuation];
+            }
+            continuation = next;
+        }
+        return;
     }
 }
 
@@ -319,56 +1456,57 @@ NSString *const BFTaskMultipleErrorsUserInfoKey = @"errors";
 - (BFTask *)continueWithExecutor:(BFExecutor *)executor
                            block:(BFContinuationBlock)block
                cancellationToken:(nullable BFCancellationToken *)cancellationToken {
-    BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
+    if (cancellationToken.cancellationRequested) {
+        return [BFTask cancelledTask];
+    }
 
-    // Capture all of the state that needs to used when the continuation is complete.
-    dispatch_block_t executionBlock = ^{
-        if (cancellationToken.cancellationRequested) {
-            [tcs cancel];
-            return;
+    // Fast path: the task is already completed and the executor would run the block right away,
+    // so run it from here, and return its outcome without creating a dependent task whenever possible.
+    BOOL instrumented = BFInstrumentationIsEnabled();
+    if (self.completed) {
+        BFTaskContinuationInvocation invocation = {
+            .task = self,
+            .block = block,
+            .cancellationToken = cancellationToken,
+            .executor = executor,
+        };
+        if (BFExecutorTryRunInline(executor,
+                                   (instrumented ? BFTaskInvokeInstrumentedContinuation : BFTaskInvokeContinuation),
+                                   &invocation)) {
+            return (BFTask *)CFBridgingRelease(invocation.resultTask);
         }
+    }
 
-        id result = block(self);
-        if ([result isKindOfClass:[BFTask class]]) {
-
-            id (^setupWithTask) (BFTask *) = ^id(BFTask *task) {
-                if (cancellationToken.cancellationRequested || task.cancelled) {
-                    [tcs cancel];
-                } else if (task.error) {
-                    tcs.error = task.error;
-                } else {
-                    tcs.result = task.result;
-                }
-                return nil;
-            };
+    BFTask *dependentTask = [[BFTask alloc] initForContinuation];
+    if (instrumented) {
+        BFInstrumentationContinuationRegistered(self, dependentTask, executor);
+    }
 
-            BFTask *resultTask = (BFTask *)result;
+    BFTaskContinuation *continuation = calloc(1, sizeof(BFTaskContinuation));
+    continuation->executor = CFBridgingRetain(executor);
+    continuation->block = CFBridgingRetain([block copy]);
+    continuation->dependentTask = CFBridgingRetain(dependentTask);
+    continuation->cancellationToken = cancellationToken ? CFBridgingRetain(cancellationToken) : NULL;
+    if (self.completed || ![self addContinuation:continuation]) {
+        continuation->next = NULL;
+        [self runContinuations:continuation];
+        return dependentTask;
+    }
 
-            if (resultTask.completed) {
-                setupWithTask(resultTask);
-            } else {
-                [resultTask continueWithBlock:setupWithTask];
+    if (cancellationToken) {
+        // Cancelling completes the dependent task right away, and unlinks the continuation from this task so that
+        // whatever it captured is released even if this task never completes.
+        BFCancellationTokenRegistration *registration = [cancellationToken registerCancellationObserverWithBlock:^{
+            if ([self removeContinuationWithIdentity:dependentTask context:0]) {
+                [dependentTask trySetCancelled];
             }
-
-        } else {
-            tcs.result = result;
-        }
-    };
-
-    BOOL completed;
-    @synchronized(self.lock) {
-        completed = self.completed;
-        if (!completed) {
-            [self.callbacks addObject:[^{
-                [executor execute:executionBlock];
-            } copy]];
-        }
-    }
-    if (completed) {
-        [executor execute:executionBlock];
+        }];
+        [dependentTask addCompletionHook:^(BFTask *task, NSUInteger context) {
+            [registration dispose];
+        } context:0];
     }
 
-    return tcs.task;
+    return dependentTask;
 }
 
 - (BFTask *)continueWithBlock:(BFContinuationBlock)block {
@@ -391,6 +1529,19 @@ NSString *const BFTaskMultipleErrorsUserInfoKey = @"errors";
         return [BFTask cancelledTask];
     }
 
+    // A completed failure has no block to run. Where the executor would have run the block right away,
+    // it is propagated from here; anywhere else it still goes through the executor, like before.
+    uintptr_t state = atomic_load_explicit(&_state, memory_order_acquire);
+    if (state == BFTaskStateError || state == BFTaskStateCancelled) {
+        BFTaskContinuationInvocation invocation = {
+            .task = self,
+            .executor = executor,
+        };
+        if (BFExecutorTryRunInline(executor, BFTaskSkipSuccessBlock, &invocation)) {
+            return (BFTask *)CFBridgingRelease(invocation.resultTask);
+        }
+    }
+
     return [self continueWithExecutor:executor block:^id(BFTask *task) {
         if (task.faulted || task.cancelled) {
             return task;
@@ -408,6 +1559,39 @@ NSString *const BFTaskMultipleErrorsUserInfoKey = @"errors";
     return [self continueWithExecutor:[BFExecutor defaultExecutor] successBlock:block cancellationToken:cancellationToken];
 }
 
+#pragma mark - Timeout
+
+- (BFTask *)timeoutAfterDelay:(int)millis {
+    return [self timeoutAfterDelay:millis cancellationTokenSource:nil];
+}
+
+- (BFTask *)timeoutAfterDelay:(int)millis cancellationTokenSource:(nullable BFCancellationTokenSource *)cancellationTokenSource {
+    if (self.completed) {
+        return self;
+    }
+
+    BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
+    BFTimerWheel *timerWheel = [BFTimerWheel sharedTimerWheel];
+    BFTimerWheelEntry *entry = [timerWheel scheduleBlock:^{
+        NSError *error = [NSError errorWithDomain:BFTaskErrorDomain code:kBFTimeoutError userInfo:nil];
+        if ([tcs trySetError:error]) {
+            [cancellationTokenSource cancel];
+        }
+    } afterDelay:millis];
+
+    [self addCompletionHook:^(BFTask *task, NSUInteger context) {
+        [timerWheel cancelEntry:entry];
+        if (task.faulted) {
+            [tcs trySetError:task.error];
+        } else if (task.cancelled) {
+            [tcs trySetCancelled];
+        } else {
+            [tcs trySetResult:task.result];
+        }
+    } context:0];
+    return tcs.task;
+}
+
 #pragma mark - Syncing Task (Avoid it)
 
 - (void)warnOperationOnMainThread {
@@ -415,39 +1599,44 @@ NSString *const BFTaskMultipleErrorsUserInfoKey = @"errors";
 }
 
 - (void)waitUntilFinished {
+    [self waitUntilFinishedBeforeDeadline:DISPATCH_TIME_FOREVER];
+}
+
+- (BOOL)waitUntilFinishedWithTimeout:(int)millis {
+    return [self waitUntilFinishedBeforeDeadline:dispatch_time(DISPATCH_TIME_NOW, (int64_t)millis * NSEC_PER_MSEC)];
+}
+
+- (BOOL)waitUntilFinishedBeforeDeadline:(dispatch_time_t)deadline {
     if ([NSThread isMainThread]) {
         [self warnOperationOnMainThread];
     }
-
-    @synchronized(self.lock) {
-        if (self.completed) {
-            return;
-        }
-        [self.condition lock];
+    if (self.completed) {
+        return YES;
     }
-    // TODO: (nlutsenko) Restructure this to use Bolts-Swift thread access synchronization architecture
-    // In the meantime, it's absolutely safe to get `_completed` aka an ivar, as long as it's a `BOOL` aka less than word size.
-    while (!_completed) {
-        [self.condition wait];
+    return BFTaskWaitUntilAllTasksFinished(@[ self ], deadline);
+}
+
++ (void)waitUntilAllTasksFinished:(nullable NSArray<BFTask *> *)tasks {
+    [self waitUntilAllTasksFinished:tasks deadline:DISPATCH_TIME_FOREVER];
+}
+
++ (BOOL)waitUntilAllTasksFinished:(nullable NSArray<BFTask *> *)tasks deadline:(dispatch_time_t)deadline {
+    if ([NSThread isMainThread]) {
+        warnBlockingOperationOnMainThread();
     }
-    [self.condition unlock];
+    return BFTaskWaitUntilAllTasksFinished(tasks ?: @[], deadline);
 }
 
 #pragma mark - NSObject
 
 - (NSString *)description {
-    // Acquire the data from the locked properties
-    BOOL completed;
-    BOOL cancelled;
-    BOOL faulted;
-    NSString *resultDescription = nil;
-
-    @synchronized(self.lock) {
-        completed = self.completed;
-        cancelled = self.cancelled;
-        faulted = self.faulted;
-        resultDescription = completed ? [NSString stringWithFormat:@" result = %@", self.result] : @"";
-    }
+    // Take a single snapshot of the state, so that all the flags are consistent with each other.
+    uintptr_t state = 0;
+    BFTask *root = BFTaskLoadRootState(self, &state);
+    BOOL completed = BFTaskStateIsCompleted(state);
+    BOOL cancelled = (state == BFTaskStateCancelled);
+    BOOL faulted = (state == BFTaskStateError);
+    NSString *resultDescription = completed ? [NSString stringWithFormat:@" result = %@", (state == BFTaskStateResult ? root->_value : nil)] : @"";
 
     // Description string includes status information and, if available, the
     // result since in some ways this is what a promise actually "is".
@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*!
+ Records the graph of tasks and continuations, and exports it in the Chrome trace event format,
+ which chrome://tracing and Perfetto open.
+
+ In the trace, every task created while tracing is an async slice from its creation to its completion,
+ and every continuation is a slice on the thread it ran on, named after its executor, with the task it was registered on
+ and the task it completes as arguments. A flow arrow links the point a continuation was scheduled at to its slice,
+ so following the arrows back from a slow continuation gives the critical path that led to it.
+
+ Tracing enables `BFInstrumentation` and takes its event observer, forwarding the events to the previous observer.
+ Tasks are identified by their addresses, which may be reused once a task is deallocated.
+ */
+@interface BFTaskTracing : NSObject
+
+/*!
+ Whether tracing is recording.
+ */
++ (BOOL)isTracing;
+
+/*!
+ Discards any previous trace and starts recording.
+ At most `maximumEventCount` events are recorded, later ones are dropped.
+ */
++ (void)startTracingWithMaximumEventCount:(NSUInteger)maximumEventCount;
+
+/*!
+ Starts recording up to a million events.
+ */
++ (void)startTracing;
+
+/*!
+ Stops recording and restores the previous instrumentation settings. The trace is kept until tracing starts again.
+ */
++ (void)stopTracing;
+
+/*!
+ Returns the trace recorded so far, as Chrome trace event JSON.
+ */
++ (NSData *)traceData;
+
+/*!
+ Writes the trace recorded so far to a file, as Chrome trace event JSON.
+ */
++ (BOOL)writeTraceToFile:(NSString *)path error:(NSError *_Nullable *_Nullable)error;
+
+- (instancetype)init NS_UNAVAILABLE;
++ (instancetype)new NS_UNAVAILABLE;
+
+@end
+
+NS_ASSUME_NONNULL_END
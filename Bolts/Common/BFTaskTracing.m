@@ -0,0 +1,263 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import "BFTaskTracing.h"
+
+#import <pthread.h>
+
+#import "BFAtomics.h"
+#import "BFClock.h"
+#import "BFExecutor.h"
+#import "BFInstrumentation.h"
+#import "BFTask.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+static const NSUInteger BFTaskTracingDefaultMaximumEventCount = 1000000;
+
+/*!
+ An instrumentation event, with its objects reduced to identities so that it can outlive them.
+ */
+typedef struct BFTaskTraceRecord {
+    BFInstrumentationEventType type;
+    uint64_t timestamp;
+    uintptr_t task;
+    uintptr_t dependentTask;
+    uintptr_t executor;
+    uintptr_t continuation;
+    uintptr_t thread;
+} BFTaskTraceRecord;
+
+// Everything below is guarded by the lock, except for the flag that is checked before taking it
+// and for the previous observer, which every event calls without holding the lock.
+static pthread_mutex_t BFTaskTracingLock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool BFTaskTracingRecording;
+static BFTaskTraceRecord *BFTaskTracingRecords;
+static NSUInteger BFTaskTracingRecordCount;
+static NSUInteger BFTaskTracingRecordCapacity;
+static NSUInteger BFTaskTracingMaximumRecordCount;
+static NSUInteger BFTaskTracingDroppedRecordCount;
+static uint64_t BFTaskTracingStartTimestamp;
+static BOOL BFTaskTracingPreviousEnabled;
+// Written under the lock, read atomically as it may change while events are recorded on other threads.
+static _Atomic(BFInstrumentationEventObserver) BFTaskTracingPreviousObserver;
+
+static void BFTaskTracingRecordEvent(const BFInstrumentationEvent *event) {
+    // A task created completed has no duration, and nothing depends on it that did not show up already.
+    BOOL skipped = event->type == BFInstrumentationEventTypeTaskCreated && event->task.completed;
+    if (!skipped && atomic_load_explicit(&BFTaskTracingRecording, memory_order_relaxed)) {
+        BFTaskTraceRecord record = {
+            .type = event->type,
+            .timestamp = event->timestamp,
+            .task = (uintptr_t)(__bridge void *)event->task,
+            .dependentTask = (uintptr_t)(__bridge void *)event->dependentTask,
+            .executor = (uintptr_t)(__bridge void *)event->executor,
+            .continuation = event->continuation,
+            .thread = (uintptr_t)pthread_self(),
+        };
+
+        pthread_mutex_lock(&BFTaskTracingLock);
+        if (BFTaskTracingRecordCount == BFTaskTracingMaximumRecordCount) {
+            BFTaskTracingDroppedRecordCount++;
+        } else {
+            if (BFTaskTracingRecordCount == BFTaskTracingRecordCapacity) {
+                BFTaskTracingRecordCapacity = MIN(MAX(BFTaskTracingRecordCapacity * 2, (NSUInteger)1024),
+                                                  BFTaskTracingMaximumRecordCount);
+                BFTaskTracingRecords = realloc(BFTaskTracingRecords, BFTaskTracingRecordCapacity * sizeof(BFTaskTraceRecord));
+            }
+            BFTaskTracingRecords[BFTaskTracingRecordCount++] = record;
+        }
+        pthread_mutex_unlock(&BFTaskTracingLock);
+    }
+
+    BFInstrumentationEventObserver previousObserver = atomic_load_explicit(&BFTaskTracingPreviousObserver,
+                                                                           memory_order_acquire);
+    if (previousObserver) {
+        previousObserver(event);
+    }
+}
+
+static NSString *BFTaskTracingIdentifier(uintptr_t identity) {
+    return [NSString stringWithFormat:@"0x%llx", (unsigned long long)identity];
+}
+
+static NSString *BFTaskTracingExecutorName(uintptr_t executor) {
+    if (executor == (uintptr_t)(__bridge void *)[BFExecutor defaultExecutor]) {
+        return @"defaultExecutor";
+    }
+    if (executor == (uintptr_t)(__bridge void *)[BFExecutor immediateExecutor]) {
+        return @"immediateExecutor";
+    }
+    if (executor == (uintptr_t)(__bridge void *)[BFExecutor mainThreadExecutor]) {
+        return @"mainThreadExecutor";
+    }
+    return [@"executor " stringByAppendingString:BFTaskTracingIdentifier(executor)];
+}
+
+@implementation BFTaskTracing
+
+#pragma mark - Recording
+
++ (BOOL)isTracing {
+    return atomic_load_explicit(&BFTaskTracingRecording, memory_order_relaxed);
+}
+
++ (void)startTracing {
+    [self startTracingWithMaximumEventCount:BFTaskTracingDefaultMaximumEventCount];
+}
+
++ (void)startTracingWithMaximumEventCount:(NSUInteger)maximumEventCount {
+    pthread_mutex_lock(&BFTaskTracingLock);
+    free(BFTaskTracingRecords);
+    BFTaskTracingRecords = NULL;
+    BFTaskTracingRecordCount = 0;
+    BFTaskTracingRecordCapacity = 0;
+    BFTaskTracingMaximumRecordCount = maximumEventCount;
+    BFTaskTracingDroppedRecordCount = 0;
+    BFTaskTracingStartTimestamp = BFClockNowNanoseconds();
+
+    if (!atomic_load_explicit(&BFTaskTracingRecording, memory_order_relaxed)) {
+        BFTaskTracingPreviousEnabled = [BFInstrumentation isEnabled];
+        atomic_store_explicit(&BFTaskTracingPreviousObserver, [BFInstrumentation eventObserver], memory_order_release);
+        [BFInstrumentation setEventObserver:BFTaskTracingRecordEvent];
+        [BFInstrumentation setEnabled:YES];
+        atomic_store_explicit(&BFTaskTracingRecording, true, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&BFTaskTracingLock);
+}
+
++ (void)stopTracing {
+    pthread_mutex_lock(&BFTaskTracingLock);
+    if (atomic_load_explicit(&BFTaskTracingRecording, memory_order_relaxed)) {
+        atomic_store_explicit(&BFTaskTracingRecording, false, memory_order_relaxed);
+        [BFInstrumentation setEnabled:BFTaskTracingPreviousEnabled];
+        // Events still in flight keep being forwarded to the previous observer, until tracing starts again.
+        [BFInstrumentation setEventObserver:atomic_load_explicit(&BFTaskTracingPreviousObserver, memory_order_relaxed)];
+    }
+    pthread_mutex_unlock(&BFTaskTracingLock);
+}
+
+#pragma mark - Export
+
++ (NSData *)traceData {
+    NSMutableArray<NSDictionary *> *traceEvents = [NSMutableArray array];
+    NSMutableDictionary<NSNumber *, NSNumber *> *threadIdentifiers = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSNumber *, NSNumber *> *dependentTasks = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSNumber *, NSNumber *> *scheduledTimestamps = [NSMutableDictionary dictionary];
+    NSMutableSet<NSNumber *> *createdTasks = [NSMutableSet set];
+    NSUInteger droppedEventCount = 0;
+
+    pthread_mutex_lock(&BFTaskTracingLock);
+    droppedEventCount = BFTaskTracingDroppedRecordCount;
+    for (NSUInteger i = 0; i < BFTaskTracingRecordCount; i++) {
+        const BFTaskTraceRecord *record = &BFTaskTracingRecords[i];
+
+        // Chrome wants small thread identifiers, and timestamps in microseconds.
+        NSNumber *thread = @(record->thread);
+        NSNumber *threadIdentifier = threadIdentifiers[thread];
+        if (!threadIdentifier) {
+            threadIdentifier = @(threadIdentifiers.count + 1);
+            threadIdentifiers[thread] = threadIdentifier;
+        }
+        uint64_t nanoseconds = record->timestamp > BFTaskTracingStartTimestamp
+            ? record->timestamp - BFTaskTracingStartTimestamp
+            : 0;
+        NSDictionary *common = @{ @"pid" : @1, @"tid" : threadIdentifier, @"ts" : @(nanoseconds / 1000.0) };
+        NSNumber *task = @(record->task);
+        NSNumber *continuation = @(record->continuation);
+
+        NSMutableDictionary *traceEvent = [common mutableCopy];
+        switch (record->type) {
+            case BFInstrumentationEventTypeTaskCreated: {
+                [createdTasks addObject:task];
+                [traceEvent addEntriesFromDictionary:@{ @"name" : @"task",
+                                                        @"cat" : @"task",
+                                                        @"ph" : @"b",
+                                                        @"id" : BFTaskTracingIdentifier(record->task) }];
+                break;
+            }
+            case BFInstrumentationEventTypeTaskCompleted: {
+                // The start of a task created before tracing is unknown, so it has no slice.
+                if (![createdTasks containsObject:task]) {
+                    continue;
+                }
+                [createdTasks removeObject:task];
+                [traceEvent addEntriesFromDictionary:@{ @"name" : @"task",
+                                                        @"cat" : @"task",
+                                                        @"ph" : @"e",
+                                                        @"id" : BFTaskTracingIdentifier(record->task) }];
+                break;
+            }
+            case BFInstrumentationEventTypeContinuationRegistered: {
+                if (record->dependentTask) {
+                    dependentTasks[continuation] = @(record->dependentTask);
+                }
+                continue;
+            }
+            case BFInstrumentationEventTypeContinuationScheduled: {
+                scheduledTimestamps[continuation] = @(record->timestamp);
+                [traceEvent addEntriesFromDictionary:@{ @"name" : @"scheduled",
+                                                        @"cat" : @"continuation",
+                                                        @"ph" : @"s",
+                                                        @"id" : BFTaskTracingIdentifier(record->continuation) }];
+                break;
+            }
+            case BFInstrumentationEventTypeContinuationStarted: {
+                NSMutableDictionary *arguments = [@{ @"task" : BFTaskTracingIdentifier(record->task) } mutableCopy];
+                NSNumber *dependentTask = dependentTasks[continuation];
+                if (dependentTask) {
+                    arguments[@"dependentTask"] = BFTaskTracingIdentifier(dependentTask.unsignedLongLongValue);
+                    [dependentTasks removeObjectForKey:continuation];
+                }
+                NSNumber *scheduledTimestamp = scheduledTimestamps[continuation];
+                if (scheduledTimestamp) {
+                    arguments[@"queuedMicroseconds"] = @((record->timestamp - scheduledTimestamp.unsignedLongLongValue) / 1000.0);
+                    [scheduledTimestamps removeObjectForKey:continuation];
+                }
+                [traceEvent addEntriesFromDictionary:@{ @"name" : BFTaskTracingExecutorName(record->executor),
+                                                        @"cat" : @"continuation",
+                                                        @"ph" : @"B",
+                                                        @"args" : arguments }];
+                [traceEvents addObject:traceEvent];
+
+                // Chrome binds the end of the flow to the slice that encloses it, the one that just began.
+                if (scheduledTimestamp) {
+                    NSMutableDictionary *flowEnd = [common mutableCopy];
+                    [flowEnd addEntriesFromDictionary:@{ @"name" : @"scheduled",
+                                                         @"cat" : @"continuation",
+                                                         @"ph" : @"f",
+                                                         @"bp" : @"e",
+                                                         @"id" : BFTaskTracingIdentifier(record->continuation) }];
+                    [traceEvents addObject:flowEnd];
+                }
+                continue;
+            }
+            case BFInstrumentationEventTypeContinuationFinished: {
+                [traceEvent addEntriesFromDictionary:@{ @"ph" : @"E" }];
+                break;
+            }
+        }
+        [traceEvents addObject:traceEvent];
+    }
+    pthread_mutex_unlock(&BFTaskTracingLock);
+
+    NSDictionary *trace = @{ @"traceEvents" : traceEvents,
+                             @"displayTimeUnit" : @"ns",
+                             @"otherData" : @{ @"droppedEventCount" : @(droppedEventCount) } };
+    return [NSJSONSerialization dataWithJSONObject:trace options:0 error:NULL];
+}
+
++ (BOOL)writeTraceToFile:(NSString *)path error:(NSError *_Nullable *_Nullable)error {
+    return [[self traceData] writeToFile:path options:NSDataWritingAtomic error:error];
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -11,10 +11,14 @@
 #import <Bolts/BFCancellationToken.h>
 #import <Bolts/BFCancellationTokenRegistration.h>
 #import <Bolts/BFCancellationTokenSource.h>
+#import <Bolts/BFChannel.h>
 #import <Bolts/BFExecutor.h>
 #import <Bolts/BFGeneric.h>
+#import <Bolts/BFInstrumentation.h>
+#import <Bolts/BFKeyedExecutor.h>
 #import <Bolts/BFTask.h>
 #import <Bolts/BFTaskCompletionSource.h>
+#import <Bolts/BFTaskTracing.h>
 
 #if __has_include(<Bolts/BFAppLink.h>) && TARGET_OS_IPHONE && !TARGET_OS_WATCH && !TARGET_OS_TV
 #import <Bolts/BFAppLink.h>
@@ -0,0 +1,74 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+#if __has_include(<stdatomic.h>)
+#import <stdatomic.h>
+#else
+#error Bolts requires C11 atomics (<stdatomic.h>).
+#endif
+
+/*!
+ The atomics used by `Bolts/Common`, built on C11 atomics only,
+ so that the core builds wherever clang does (Apple platforms, or GNUstep with libdispatch on Linux).
+ Each helper spells out the weakest memory ordering its callers rely on.
+ */
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*!
+ A counter of events, like the number of inputs of a combinator that are left to complete.
+ */
+typedef atomic_size_t BFAtomicCounter;
+
+/*!
+ A flag that is set at most once, like whether a combinator completed its task already.
+ */
+typedef atomic_bool BFAtomicFlag;
+
+static inline void BFAtomicCounterInit(BFAtomicCounter *counter, size_t value) {
+    atomic_init(counter, value);
+}
+
+/*!
+ Increments the counter. Only the count itself is published,
+ read it once all of the incrementing threads synchronized through some other means.
+ */
+static inline void BFAtomicCounterIncrement(BFAtomicCounter *counter) {
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+static inline size_t BFAtomicCounterLoad(BFAtomicCounter *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+/*!
+ Decrements the counter.
+ @returns `YES` for the single caller that brought it to zero,
+ which observes every write made by the other callers before their own decrement.
+ */
+static inline BOOL BFAtomicCounterDecrementToZero(BFAtomicCounter *counter) {
+    return atomic_fetch_sub_explicit(counter, 1, memory_order_acq_rel) == 1;
+}
+
+/*!
+ Sets the flag.
+ @returns `YES` for the single caller that set it first.
+ */
+static inline BOOL BFAtomicFlagTrySet(BFAtomicFlag *flag) {
+    return !atomic_exchange_explicit(flag, true, memory_order_acq_rel);
+}
+
+static inline BOOL BFAtomicFlagIsSet(BFAtomicFlag *flag) {
+    return atomic_load_explicit(flag, memory_order_acquire);
+}
+
+NS_ASSUME_NONNULL_END
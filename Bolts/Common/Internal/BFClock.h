@@ -0,0 +1,119 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+#import <sys/time.h>
+#if __APPLE__
+#import <mach/mach_time.h>
+#else
+#import <time.h>
+#endif
+
+NS_ASSUME_NONNULL_BEGIN
+
+#if __APPLE__
+static inline uint64_t BFClockNanosecondsFromAbsoluteTime(uint64_t absoluteTime) {
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info(&timebase);
+    });
+    return absoluteTime * timebase.numer / timebase.denom;
+}
+#endif
+
+/*!
+ Returns the current time of a monotonic clock, in nanoseconds since an arbitrary point in the past.
+ Unlike the wall clock, it never jumps when the system time is changed, and it matches `DISPATCH_TIME_NOW`.
+ */
+static inline uint64_t BFClockNowNanoseconds(void) {
+#if __APPLE__
+    return BFClockNanosecondsFromAbsoluteTime(mach_absolute_time());
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NSEC_PER_SEC + (uint64_t)now.tv_nsec;
+#endif
+}
+
+/*!
+ Returns the current time of the wall clock, in nanoseconds since 1970, which is what `dispatch_walltime()` counts.
+ */
+static inline uint64_t BFClockWallNanoseconds(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (uint64_t)now.tv_sec * NSEC_PER_SEC + (uint64_t)now.tv_usec * NSEC_PER_USEC;
+}
+
+/*!
+ Returns how long it is until the given deadline of the clock that keeps running while the system sleeps,
+ in the raw value that libdispatch stores for it: mach continuous time on Apple platforms,
+ nanoseconds of the boot time clock elsewhere.
+ */
+static inline uint64_t BFClockNanosecondsUntilContinuousTime(uint64_t continuousTime) {
+#if __APPLE__
+    if (@available(macOS 10.12, iOS 10.0, watchOS 3.0, tvOS 10.0, *)) {
+        uint64_t now = mach_continuous_time();
+        return continuousTime > now ? BFClockNanosecondsFromAbsoluteTime(continuousTime - now) : 0;
+    }
+    // Such deadlines only exist where the continuous clock does.
+    return 0;
+#else
+    struct timespec now;
+#ifdef CLOCK_BOOTTIME
+    clock_gettime(CLOCK_BOOTTIME, &now);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+    uint64_t nowNanoseconds = (uint64_t)now.tv_sec * NSEC_PER_SEC + (uint64_t)now.tv_nsec;
+    return continuousTime > nowNanoseconds ? continuousTime - nowNanoseconds : 0;
+#endif
+}
+
+/*!
+ The top bit of a `dispatch_time_t` is set for deadlines that are not of the uptime clock, and the one below it
+ tells wall clock deadlines, stored as negated nanoseconds since 1970, from continuous clock deadlines.
+ This is the encoding of libdispatch, on Apple platforms and elsewhere.
+ */
+static const uint64_t BFClockDispatchTimeNotUptimeBit = 1ULL << 63;
+static const uint64_t BFClockDispatchTimeWallBit = 1ULL << 62;
+
+/*!
+ Converts a `dispatch_time_t`, made with `dispatch_time()` from any of the clocks or with `dispatch_walltime()`,
+ to nanoseconds of `BFClockNowNanoseconds()`. Returns `UINT64_MAX` for `DISPATCH_TIME_FOREVER`.
+ Deadlines of other clocks are measured from now, so they don't follow later changes of those clocks.
+ */
+static inline uint64_t BFClockNanosecondsFromDispatchTime(dispatch_time_t time) {
+    if (time == DISPATCH_TIME_NOW) {
+        return BFClockNowNanoseconds();
+    }
+    if (time == DISPATCH_TIME_FOREVER) {
+        return UINT64_MAX;
+    }
+    if (time & BFClockDispatchTimeNotUptimeBit) {
+        uint64_t monotonicNow = BFClockNowNanoseconds();
+        if (time & BFClockDispatchTimeWallBit) {
+            // `dispatch_walltime(NULL, 0)` may be stored as a marker for "now", which negates to a tiny value.
+            uint64_t wallDeadline = (uint64_t)(-(int64_t)time);
+            uint64_t wallNow = BFClockWallNanoseconds();
+            return wallDeadline > wallNow ? monotonicNow + (wallDeadline - wallNow) : monotonicNow;
+        }
+        return monotonicNow + BFClockNanosecondsUntilContinuousTime(time & ~BFClockDispatchTimeNotUptimeBit);
+    }
+#if __APPLE__
+    return BFClockNanosecondsFromAbsoluteTime(time);
+#else
+    // The uptime clock of libdispatch is the monotonic clock, in nanoseconds.
+    return time;
+#endif
+}
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,58 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import <Bolts/BFExecutor.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*!
+ Runs the continuations that the default executor deferred on the current thread, in order, until the function
+ returns `YES` or none are left. Used before blocking the thread, as the awaited work might be among them,
+ while the continuations that come after it stay deferred to the outermost continuation.
+ */
+extern void BFExecutorDrainCurrentThreadTrampolineUntil(BOOL (*isDone)(void *context), void *context);
+
+/*!
+ Calls the function right away on the current thread, if that is what the executor would do with a block:
+ always for the immediate executor, and for the default one unless continuations are nested too deeply already.
+ Lets callers run continuations without allocating a block for them.
+ @returns `NO` if the function was not called, in which case it has to be submitted to the executor as a block.
+ */
+extern BOOL BFExecutorTryRunInline(BFExecutor *executor, void (*function)(void *context), void *context);
+
+/*!
+ Count the continuations submitted to the executor while instrumentation is enabled, and their starts,
+ for `+[BFInstrumentation queuedContinuationCountForExecutor:]`.
+ */
+extern void BFExecutorCountScheduledContinuation(BFExecutor *executor);
+extern void BFExecutorCountStartedContinuation(BFExecutor *executor);
+extern uint64_t BFExecutorQueuedContinuationCount(BFExecutor *executor);
+
+/*!
+ The number of `BFExecutorPriority` lanes, which are numbered from `0`.
+ */
+static const NSUInteger BFExecutorPriorityCount = BFExecutorPriorityHigh + 1;
+
+/*!
+ The priority of the block that runs on the current thread, see `+[BFExecutor currentPriority]`.
+ */
+extern BFExecutorPriority BFExecutorCurrentPriority(void);
+
+/*!
+ Runs the block with the given priority as the current one, so that what it schedules inherits it.
+ */
+extern void BFExecutorRunBlockWithPriority(BFExecutorPriority priority, dispatch_block_t block);
+
+/*!
+ Submits the block to the global dispatch queue that matches the priority, to be run with that priority.
+ */
+extern void BFExecutorDispatchAsyncWithPriority(BFExecutorPriority priority, dispatch_block_t block);
+
+NS_ASSUME_NONNULL_END
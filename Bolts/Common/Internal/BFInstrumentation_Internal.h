@@ -0,0 +1,63 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import <Bolts/BFInstrumentation.h>
+
+#import "BFAtomics.h"
+
+#ifndef BF_INSTRUMENTATION
+#define BF_INSTRUMENTATION 1
+#endif
+
+NS_ASSUME_NONNULL_BEGIN
+
+extern atomic_bool BFInstrumentationEnabledFlag;
+
+/*!
+ Whether the hooks below should be called. Check it first, so that disabled instrumentation costs a single load.
+ */
+static inline BOOL BFInstrumentationIsEnabled(void) {
+#if BF_INSTRUMENTATION
+    return atomic_load_explicit(&BFInstrumentationEnabledFlag, memory_order_relaxed);
+#else
+    return NO;
+#endif
+}
+
+extern void BFInstrumentationTaskCreated(BFTask *task);
+extern void BFInstrumentationTaskCompleted(BFTask *task);
+extern void BFInstrumentationTaskDeallocated(void);
+
+/*!
+ Records the registration of a continuation, identified by the task it completes.
+ */
+extern void BFInstrumentationContinuationRegistered(BFTask *task, BFTask *dependentTask, BFExecutor *executor);
+
+/*!
+ Records that the continuation that completes the dependent task is submitted to its executor.
+ @returns The block to submit instead, which records when the continuation starts and finishes.
+ */
+extern dispatch_block_t BFInstrumentationContinuationScheduled(BFTask *task,
+                                                               BFTask *dependentTask,
+                                                               BFExecutor *executor,
+                                                               dispatch_block_t block);
+
+/*!
+ Records a continuation of a completed task that its executor runs right away, without a dependent task,
+ as registered, scheduled, started and finished at once, and runs it in between.
+ @param continuation Identifies the continuation in its events, unique for as long as it runs.
+ */
+extern void BFInstrumentationContinuationRunInline(BFTask *task,
+                                                   BFExecutor *executor,
+                                                   uintptr_t continuation,
+                                                   void (*function)(void *context),
+                                                   void *context);
+
+NS_ASSUME_NONNULL_END
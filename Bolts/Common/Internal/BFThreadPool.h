@@ -0,0 +1,66 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+#import <Bolts/BFExecutor.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*!
+ A fixed set of worker threads, each owning a deque of blocks.
+ Blocks enqueued by a worker go to the bottom of its own deque and are run by it in LIFO order,
+ blocks enqueued by any other thread go to a shared FIFO queue.
+ An idle worker takes blocks from the shared queue, then steals the oldest blocks from the other workers' deques,
+ and parks once there is no work left anywhere.
+
+ Every priority has its own deques and shared queue, and workers look for work from the highest priority down.
+ Low priority and background blocks are never run by more than all workers but one at once, so that a worker is
+ always free for default and high priority blocks. That takes at least two workers: a single worker still runs
+ low priority blocks, and can't run anything else meanwhile.
+
+ Worker threads are started upfront and live for the lifetime of the process.
+ */
+@interface BFThreadPool : NSObject
+
+/*!
+ Creates a pool and starts its worker threads.
+ @param workerCount The number of worker threads, must be greater than `0`.
+ */
+- (instancetype)initWithWorkerCount:(NSUInteger)workerCount NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/*!
+ The number of worker threads in this pool.
+ */
+@property (nonatomic, assign, readonly) NSUInteger workerCount;
+
+/*!
+ Whether the calling thread is one of the workers of this pool.
+ */
+@property (nonatomic, assign, readonly, getter=isCurrentThreadWorker) BOOL currentThreadWorker;
+
+/*!
+ Schedules the block to be run on one of the worker threads, with the priority of the calling thread.
+ @param block The block to run.
+ */
+- (void)enqueueBlock:(dispatch_block_t)block;
+
+/*!
+ Schedules the block to be run on one of the worker threads.
+ @param block The block to run.
+ @param priority The lane to schedule the block in, which is also the current priority while it runs.
+ */
+- (void)enqueueBlock:(dispatch_block_t)block priority:(BFExecutorPriority)priority;
+
+@end
+
+NS_ASSUME_NONNULL_END
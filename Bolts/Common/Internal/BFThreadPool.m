@@ -0,0 +1,308 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import "BFThreadPool.h"
+
+#import <pthread.h>
+
+#import "BFAtomics.h"
+#import "BFExecutor_Internal.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*!
+ The pool the current thread is a worker of (unretained, pools are never deallocated), and the index of that worker.
+ */
+static __thread void *_Nullable BFThreadPoolCurrentPool;
+static __thread NSUInteger BFThreadPoolCurrentWorkerIndex;
+
+/*!
+ A growable ring buffer of retained blocks, that can be pushed to and popped from its bottom,
+ and popped from its top.
+ Critical sections are a handful of instructions, so a mutex per deque keeps owners and thieves apart cheaply.
+ */
+@interface BFThreadPoolDeque : NSObject
+
+- (void)pushBottom:(CFTypeRef)block;
+- (nullable CFTypeRef)popBottom;
+- (nullable CFTypeRef)popTop;
+
+@end
+
+@implementation BFThreadPoolDeque {
+    pthread_mutex_t _lock;
+    CFTypeRef *_buffer;
+    NSUInteger _capacity;
+    NSUInteger _top;
+    NSUInteger _count;
+}
+
+#pragma mark - Initializer
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) return self;
+
+    pthread_mutex_init(&_lock, NULL);
+    _capacity = 64;
+    _buffer = malloc(sizeof(CFTypeRef) * _capacity);
+
+    return self;
+}
+
+- (void)dealloc {
+    for (NSUInteger i = 0; i < _count; i++) {
+        CFRelease(_buffer[(_top + i) & (_capacity - 1)]);
+    }
+    free(_buffer);
+    pthread_mutex_destroy(&_lock);
+}
+
+#pragma mark - Push/Pop
+
+- (void)pushBottom:(CFTypeRef)block {
+    pthread_mutex_lock(&_lock);
+    if (_count == _capacity) {
+        [self grow];
+    }
+    _buffer[(_top + _count) & (_capacity - 1)] = block;
+    _count++;
+    pthread_mutex_unlock(&_lock);
+}
+
+- (nullable CFTypeRef)popBottom {
+    CFTypeRef block = NULL;
+    pthread_mutex_lock(&_lock);
+    if (_count > 0) {
+        _count--;
+        block = _buffer[(_top + _count) & (_capacity - 1)];
+    }
+    pthread_mutex_unlock(&_lock);
+    return block;
+}
+
+- (nullable CFTypeRef)popTop {
+    CFTypeRef block = NULL;
+    pthread_mutex_lock(&_lock);
+    if (_count > 0) {
+        block = _buffer[_top];
+        _top = (_top + 1) & (_capacity - 1);
+        _count--;
+    }
+    pthread_mutex_unlock(&_lock);
+    return block;
+}
+
+- (void)grow {
+    NSUInteger capacity = _capacity * 2;
+    CFTypeRef *buffer = malloc(sizeof(CFTypeRef) * capacity);
+    for (NSUInteger i = 0; i < _count; i++) {
+        buffer[i] = _buffer[(_top + i) & (_capacity - 1)];
+    }
+    free(_buffer);
+    _buffer = buffer;
+    _capacity = capacity;
+    _top = 0;
+}
+
+@end
+
+@implementation BFThreadPool {
+    // The deques of the workers, by priority and then by worker, and the shared queues, by priority.
+    NSArray<NSArray<BFThreadPoolDeque *> *> *_deques;
+    NSArray<BFThreadPoolDeque *> *_sharedQueues;
+
+    // Number of enqueued blocks that were not taken by a worker yet, by priority.
+    atomic_size_t _pendingCounts[BFExecutorPriorityCount];
+    // Number of workers running a low priority or background block, and how many of them there may be at most.
+    atomic_size_t _lowPriorityRunningCount;
+    NSUInteger _lowPriorityRunningLimit;
+    atomic_size_t _parkedCount;
+    pthread_mutex_t _parkingLock;
+    pthread_cond_t _parkingCondition;
+}
+
+#pragma mark - Initializer
+
+- (instancetype)initWithWorkerCount:(NSUInteger)workerCount {
+    self = [super init];
+    if (!self) return self;
+
+    if (workerCount == 0) {
+        [NSException raise:NSInvalidArgumentException format:@"Worker count must be > 0"];
+    }
+
+    _workerCount = workerCount;
+    _lowPriorityRunningLimit = MAX(workerCount - 1, (NSUInteger)1);
+    NSMutableArray *deques = [NSMutableArray arrayWithCapacity:BFExecutorPriorityCount];
+    NSMutableArray *sharedQueues = [NSMutableArray arrayWithCapacity:BFExecutorPriorityCount];
+    for (NSUInteger priority = 0; priority < BFExecutorPriorityCount; priority++) {
+        NSMutableArray *priorityDeques = [NSMutableArray arrayWithCapacity:workerCount];
+        for (NSUInteger i = 0; i < workerCount; i++) {
+            [priorityDeques addObject:[[BFThreadPoolDeque alloc] init]];
+        }
+        [deques addObject:[priorityDeques copy]];
+        [sharedQueues addObject:[[BFThreadPoolDeque alloc] init]];
+    }
+    _deques = [deques copy];
+    _sharedQueues = [sharedQueues copy];
+
+    pthread_mutex_init(&_parkingLock, NULL);
+    pthread_cond_init(&_parkingCondition, NULL);
+
+    for (NSUInteger i = 0; i < workerCount; i++) {
+        NSThread *thread = [[NSThread alloc] initWithTarget:self selector:@selector(runWorkerAtIndex:) object:@(i)];
+        thread.name = [NSString stringWithFormat:@"com.bolts.threadpool.worker.%lu", (unsigned long)i];
+        [thread start];
+    }
+
+    return self;
+}
+
+#pragma mark - Accessors
+
+- (BOOL)isCurrentThreadWorker {
+    return BFThreadPoolCurrentPool == (__bridge void *)self;
+}
+
+#pragma mark - Scheduling
+
+- (void)enqueueBlock:(dispatch_block_t)block {
+    [self enqueueBlock:block priority:BFExecutorCurrentPriority()];
+}
+
+- (void)enqueueBlock:(dispatch_block_t)block priority:(BFExecutorPriority)priority {
+    // Count the block before it becomes visible, so that a parking worker never misses it.
+    atomic_fetch_add(&_pendingCounts[priority], 1);
+
+    CFTypeRef retainedBlock = CFBridgingRetain([block copy]);
+    if (self.currentThreadWorker) {
+        [_deques[priority][BFThreadPoolCurrentWorkerIndex] pushBottom:retainedBlock];
+    } else {
+        [_sharedQueues[priority] pushBottom:retainedBlock];
+    }
+
+    [self wakeWorker];
+}
+
+#pragma mark - Workers
+
+- (void)runWorkerAtIndex:(NSNumber *)index {
+    NSUInteger workerIndex = index.unsignedIntegerValue;
+    BFThreadPoolCurrentPool = (__bridge void *)self;
+    BFThreadPoolCurrentWorkerIndex = workerIndex;
+
+    while (YES) {
+        BFExecutorPriority priority = BFExecutorPriorityDefault;
+        CFTypeRef retainedBlock = [self takeBlockForWorkerAtIndex:workerIndex priority:&priority];
+        if (!retainedBlock) {
+            retainedBlock = [self parkWorkerAtIndex:workerIndex priority:&priority];
+            if (!retainedBlock) {
+                continue;
+            }
+        }
+
+        @autoreleasepool {
+            dispatch_block_t block = (dispatch_block_t)CFBridgingRelease(retainedBlock);
+            BFExecutorRunBlockWithPriority(priority, block);
+        }
+
+        if (priority < BFExecutorPriorityDefault) {
+            // Sequentially consistent with the check of the running count by a parking worker,
+            // a worker that parked because of the limit is woken up once it is lifted.
+            atomic_fetch_sub(&_lowPriorityRunningCount, 1);
+            if (atomic_load(&_pendingCounts[BFExecutorPriorityLow]) > 0 ||
+                atomic_load(&_pendingCounts[BFExecutorPriorityBackground]) > 0) {
+                [self wakeWorker];
+            }
+        }
+    }
+}
+
+/*!
+ Takes the block to run next, from the highest priority that has any.
+ */
+- (nullable CFTypeRef)takeBlockForWorkerAtIndex:(NSUInteger)workerIndex priority:(BFExecutorPriority *)priority {
+    for (NSInteger lane = BFExecutorPriorityHigh; lane >= BFExecutorPriorityBackground; lane--) {
+        if (atomic_load(&_pendingCounts[lane]) == 0) {
+            continue;
+        }
+
+        BOOL lowPriority = lane < BFExecutorPriorityDefault;
+        if (lowPriority && atomic_fetch_add(&_lowPriorityRunningCount, 1) >= _lowPriorityRunningLimit) {
+            atomic_fetch_sub(&_lowPriorityRunningCount, 1);
+            return NULL;
+        }
+
+        CFTypeRef block = [self takeBlockForWorkerAtIndex:workerIndex lane:(BFExecutorPriority)lane];
+        if (block) {
+            atomic_fetch_sub(&_pendingCounts[lane], 1);
+            *priority = (BFExecutorPriority)lane;
+            return block;
+        }
+
+        if (lowPriority) {
+            atomic_fetch_sub(&_lowPriorityRunningCount, 1);
+        }
+    }
+    return NULL;
+}
+
+- (nullable CFTypeRef)takeBlockForWorkerAtIndex:(NSUInteger)workerIndex lane:(BFExecutorPriority)lane {
+    NSArray<BFThreadPoolDeque *> *deques = _deques[lane];
+    CFTypeRef block = [deques[workerIndex] popBottom];
+    if (block) {
+        return block;
+    }
+    block = [_sharedQueues[lane] popTop];
+    if (block) {
+        return block;
+    }
+    for (NSUInteger i = 1; i < _workerCount; i++) {
+        block = [deques[(workerIndex + i) % _workerCount] popTop];
+        if (block) {
+            return block;
+        }
+    }
+    return NULL;
+}
+
+- (void)wakeWorker {
+    if (atomic_load(&_parkedCount) > 0) {
+        pthread_mutex_lock(&_parkingLock);
+        pthread_cond_signal(&_parkingCondition);
+        pthread_mutex_unlock(&_parkingLock);
+    }
+}
+
+/*!
+ Parks the worker until a block is enqueued, unless it finds one after announcing that it parks.
+ A pending count may be raised before its block is pushed, so the worker looks for the block itself rather than at the
+ counts: if the push did not land yet, the enqueuer signals once it did, instead of the worker spinning until then.
+ @returns The block the worker found instead of parking, if any.
+ */
+- (nullable CFTypeRef)parkWorkerAtIndex:(NSUInteger)workerIndex priority:(BFExecutorPriority *)priority {
+    pthread_mutex_lock(&_parkingLock);
+    // Sequentially consistent with the increment of the pending counts in `enqueueBlock:priority:` and with the
+    // decrement of the low priority running count, either the enqueuer or the worker that lifted the limit sees this
+    // worker as parked and signals it, or this worker finds the block. Signals can't get lost while the lock is held.
+    atomic_fetch_add(&_parkedCount, 1);
+    CFTypeRef block = [self takeBlockForWorkerAtIndex:workerIndex priority:priority];
+    if (!block) {
+        pthread_cond_wait(&_parkingCondition, &_parkingLock);
+    }
+    atomic_fetch_sub(&_parkedCount, 1);
+    pthread_mutex_unlock(&_parkingLock);
+    return block;
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,63 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*!
+ A block scheduled with a `BFTimerWheel`, used to cancel it.
+ */
+@interface BFTimerWheelEntry : NSObject
+
+@end
+
+/*!
+ A hierarchical timer wheel with a resolution of 100 microseconds.
+ Scheduling and cancelling a block are O(1), and a single dispatch timer is armed for the earliest event
+ of the whole wheel, so that many concurrent delays and timeouts cost no more than one timer.
+ Expired blocks are run on the global queue that matches the priority of the thread that scheduled them,
+ with that priority, see `+[BFExecutor currentPriority]`.
+ */
+@interface BFTimerWheel : NSObject
+
+/*!
+ The timer wheel used by delays and timeouts.
+ */
++ (instancetype)sharedTimerWheel;
+
+/*!
+ The number of blocks that are scheduled and were neither run nor cancelled yet.
+ */
+@property (nonatomic, assign, readonly) NSUInteger count;
+
+/*!
+ Schedules the block to be run once the deadline has passed.
+ @param block The block to run.
+ @param deadline The deadline, in nanoseconds of `BFClockNowNanoseconds()`.
+ If it has passed already, the block is run right away.
+ @returns The entry to cancel the block with.
+ */
+- (BFTimerWheelEntry *)scheduleBlock:(dispatch_block_t)block atDeadline:(uint64_t)deadline;
+
+/*!
+ Schedules the block to be run after the given number of milliseconds.
+ */
+- (BFTimerWheelEntry *)scheduleBlock:(dispatch_block_t)block afterDelay:(int64_t)millis;
+
+/*!
+ Removes the entry from the wheel and releases its block right away.
+ @returns `YES` if the block will never be run, `NO` if it was run or cancelled already.
+ */
+- (BOOL)cancelEntry:(BFTimerWheelEntry *)entry;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,346 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import "BFTimerWheel.h"
+
+#import <pthread.h>
+
+#import "BFClock.h"
+#import "BFExecutor_Internal.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*
+ Every level has 64 slots, and each slot of a level spans 64 times as many ticks as a slot of the level below it,
+ so that 4 levels cover 2^24 ticks (about 28 minutes), later deadlines wait in the last level until they get closer.
+ An entry is placed in the lowest level that its distance to the current tick fits in,
+ and is moved down to a lower level (cascaded) once the current tick reaches the start of the slot it is in.
+ */
+static const NSUInteger BFTimerWheelLevelCount = 4;
+static const NSUInteger BFTimerWheelSlotBits = 6;
+static const NSUInteger BFTimerWheelSlotCount = 1 << BFTimerWheelSlotBits;
+static const uint64_t BFTimerWheelSlotMask = BFTimerWheelSlotCount - 1;
+static const uint64_t BFTimerWheelRange = 1ull << (BFTimerWheelSlotBits * BFTimerWheelLevelCount);
+static const uint64_t BFTimerWheelTickNanoseconds = 100 * NSEC_PER_USEC;
+
+@interface BFTimerWheelEntry () {
+@public
+    // The links of the slot the entry is in, only accessed with the lock of the wheel held.
+    __unsafe_unretained BFTimerWheelEntry *_Nullable _previous;
+    __unsafe_unretained BFTimerWheelEntry *_Nullable _next;
+    uint64_t _tick;
+    NSUInteger _level;
+    NSUInteger _slot;
+    // The priority of the thread that scheduled the block, which the block is run with.
+    BFExecutorPriority _priority;
+    // Set while the entry is scheduled, cleared once it is run or cancelled.
+    dispatch_block_t _Nullable _block;
+}
+
+@end
+
+@implementation BFTimerWheelEntry
+
+@end
+
+@implementation BFTimerWheel {
+    pthread_mutex_t _lock;
+    dispatch_source_t _timer;
+    uint64_t _startTime;
+
+    // Every entry with a tick up to this one was run already.
+    uint64_t _currentTick;
+    // The tick the timer is armed for, or `UINT64_MAX`.
+    uint64_t _armedTick;
+    NSUInteger _count;
+    // Scheduled entries are retained by the wheel while they are linked into a slot.
+    __unsafe_unretained BFTimerWheelEntry *_Nullable _slots[BFTimerWheelLevelCount][BFTimerWheelSlotCount];
+    uint64_t _occupiedSlots[BFTimerWheelLevelCount];
+}
+
+#pragma mark - Initializer
+
++ (instancetype)sharedTimerWheel {
+    static BFTimerWheel *timerWheel;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        timerWheel = [[self alloc] init];
+    });
+    return timerWheel;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (!self) return self;
+
+    pthread_mutex_init(&_lock, NULL);
+    _startTime = BFClockNowNanoseconds();
+    _armedTick = UINT64_MAX;
+
+    dispatch_queue_t queue = dispatch_queue_create("com.bolts.timerwheel", DISPATCH_QUEUE_SERIAL);
+    _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+    __weak BFTimerWheel *weakSelf = self;
+    dispatch_source_set_event_handler(_timer, ^{
+        [weakSelf advance];
+    });
+    dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+    dispatch_resume(_timer);
+
+    return self;
+}
+
+- (void)dealloc {
+    dispatch_source_cancel(_timer);
+    for (NSUInteger level = 0; level < BFTimerWheelLevelCount; level++) {
+        for (NSUInteger slot = 0; slot < BFTimerWheelSlotCount; slot++) {
+            BFTimerWheelEntry *entry = _slots[level][slot];
+            while (entry) {
+                BFTimerWheelEntry *next = entry->_next;
+                entry->_block = nil;
+                CFRelease((__bridge CFTypeRef)entry);
+                entry = next;
+            }
+        }
+    }
+    pthread_mutex_destroy(&_lock);
+}
+
+#pragma mark - Accessors
+
+- (NSUInteger)count {
+    pthread_mutex_lock(&_lock);
+    NSUInteger count = _count;
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+#pragma mark - Scheduling
+
+- (BFTimerWheelEntry *)scheduleBlock:(dispatch_block_t)block afterDelay:(int64_t)millis {
+    return [self scheduleBlock:block atDeadline:BFClockNowNanoseconds() + (uint64_t)MAX(millis, 0) * NSEC_PER_MSEC];
+}
+
+- (BFTimerWheelEntry *)scheduleBlock:(dispatch_block_t)block atDeadline:(uint64_t)deadline {
+    BFTimerWheelEntry *entry = [[BFTimerWheelEntry alloc] init];
+    BFExecutorPriority priority = BFExecutorCurrentPriority();
+    // Round up, so that a block never runs before its deadline.
+    uint64_t tick = (deadline > _startTime ?
+                     (deadline - _startTime + BFTimerWheelTickNanoseconds - 1) / BFTimerWheelTickNanoseconds :
+                     0);
+
+    pthread_mutex_lock(&_lock);
+    if (_count == 0) {
+        // Nothing had to be tracked while the wheel was empty, catch up with the clock right away.
+        _currentTick = MAX(_currentTick, [self nowTick]);
+    }
+    if (tick <= _currentTick) {
+        pthread_mutex_unlock(&_lock);
+        BFExecutorDispatchAsyncWithPriority(priority, block);
+        return entry;
+    }
+
+    entry->_tick = tick;
+    entry->_priority = priority;
+    entry->_block = [block copy];
+    (void)CFBridgingRetain(entry);
+    [self linkEntry:entry];
+    _count++;
+    [self armTimer];
+    pthread_mutex_unlock(&_lock);
+
+    return entry;
+}
+
+- (BOOL)cancelEntry:(BFTimerWheelEntry *)entry {
+    pthread_mutex_lock(&_lock);
+    dispatch_block_t block = entry->_block;
+    if (!block) {
+        pthread_mutex_unlock(&_lock);
+        return NO;
+    }
+    [self unlinkEntry:entry];
+    entry->_block = nil;
+    _count--;
+    pthread_mutex_unlock(&_lock);
+
+    // Release the block, and whatever it captured, outside of the lock.
+    block = nil;
+    CFRelease((__bridge CFTypeRef)entry);
+    return YES;
+}
+
+#pragma mark - Wheel
+
+- (uint64_t)nowTick {
+    uint64_t now = BFClockNowNanoseconds();
+    return now > _startTime ? (now - _startTime) / BFTimerWheelTickNanoseconds : 0;
+}
+
+- (void)linkEntry:(BFTimerWheelEntry *)entry {
+    uint64_t tick = entry->_tick;
+    uint64_t distance = tick - _currentTick;
+    if (distance >= BFTimerWheelRange) {
+        // Park it in the slot of the last level that is cascaded last, it is placed again from there.
+        distance = BFTimerWheelRange - 1;
+        tick = _currentTick + distance;
+    }
+
+    NSUInteger level = 0;
+    while (distance >= (1ull << (BFTimerWheelSlotBits * (level + 1)))) {
+        level++;
+    }
+    NSUInteger slot = (NSUInteger)((tick >> (BFTimerWheelSlotBits * level)) & BFTimerWheelSlotMask);
+
+    BFTimerWheelEntry *head = _slots[level][slot];
+    entry->_level = level;
+    entry->_slot = slot;
+    entry->_previous = nil;
+    entry->_next = head;
+    if (head) {
+        head->_previous = entry;
+    }
+    _slots[level][slot] = entry;
+    _occupiedSlots[level] |= 1ull << slot;
+}
+
+- (void)unlinkEntry:(BFTimerWheelEntry *)entry {
+    if (entry->_previous) {
+        entry->_previous->_next = entry->_next;
+    } else {
+        _slots[entry->_level][entry->_slot] = entry->_next;
+        if (!entry->_next) {
+            _occupiedSlots[entry->_level] &= ~(1ull << entry->_slot);
+        }
+    }
+    if (entry->_next) {
+        entry->_next->_previous = entry->_previous;
+    }
+    entry->_previous = nil;
+    entry->_next = nil;
+}
+
+/*!
+ Returns the first tick after the current one at which an entry expires or has to be cascaded, or `UINT64_MAX`.
+ */
+- (uint64_t)nextEventTick {
+    if (_count == 0) {
+        return UINT64_MAX;
+    }
+
+    uint64_t nextTick = UINT64_MAX;
+    if (_occupiedSlots[0]) {
+        // Entries of the first level all expire within the next 63 ticks, find the first occupied slot after the current one.
+        NSUInteger shift = (NSUInteger)((_currentTick + 1) & BFTimerWheelSlotMask);
+        uint64_t slots = _occupiedSlots[0];
+        uint64_t rotatedSlots = shift == 0 ? slots : (slots >> shift) | (slots << (BFTimerWheelSlotCount - shift));
+        nextTick = _currentTick + 1 + (uint64_t)__builtin_ctzll(rotatedSlots);
+    }
+    for (NSUInteger level = 1; level < BFTimerWheelLevelCount; level++) {
+        if (_occupiedSlots[level]) {
+            // Slots of this level are only cascaded at multiples of its span. The levels between the first one, handled
+            // above, and this one are empty, and the higher levels cascade at multiples of their own spans, which are
+            // multiples of this one, so none of them has an event before this level does.
+            NSUInteger bits = BFTimerWheelSlotBits * level;
+            nextTick = MIN(nextTick, ((_currentTick >> bits) + 1) << bits);
+            break;
+        }
+    }
+    return nextTick;
+}
+
+- (void)armTimer {
+    uint64_t nextTick = [self nextEventTick];
+    if (nextTick == _armedTick) {
+        return;
+    }
+    _armedTick = nextTick;
+    if (nextTick == UINT64_MAX) {
+        dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        return;
+    }
+
+    uint64_t deadline = _startTime + nextTick * BFTimerWheelTickNanoseconds;
+    uint64_t now = BFClockNowNanoseconds();
+    int64_t delay = deadline > now ? (int64_t)(deadline - now) : 0;
+    dispatch_source_set_timer(_timer,
+                              dispatch_time(DISPATCH_TIME_NOW, delay),
+                              DISPATCH_TIME_FOREVER,
+                              BFTimerWheelTickNanoseconds);
+}
+
+/*!
+ Takes every entry of the slot, and either places it again relative to the current tick or adds its block to the
+ expired ones of its priority.
+ */
+- (void)cascadeLevel:(NSUInteger)level
+                slot:(NSUInteger)slot
+       expiredBlocks:(NSArray<NSMutableArray<dispatch_block_t> *> *)expiredBlocks {
+    BFTimerWheelEntry *entry = _slots[level][slot];
+    _slots[level][slot] = nil;
+    _occupiedSlots[level] &= ~(1ull << slot);
+
+    while (entry) {
+        BFTimerWheelEntry *next = entry->_next;
+        entry->_previous = nil;
+        entry->_next = nil;
+        if (entry->_tick <= _currentTick) {
+            [expiredBlocks[entry->_priority] addObject:entry->_block];
+            entry->_block = nil;
+            _count--;
+            CFRelease((__bridge CFTypeRef)entry);
+        } else {
+            [self linkEntry:entry];
+        }
+        entry = next;
+    }
+}
+
+- (void)advance {
+    NSMutableArray<NSMutableArray<dispatch_block_t> *> *expiredBlocks = [NSMutableArray array];
+    for (NSUInteger priority = 0; priority < BFExecutorPriorityCount; priority++) {
+        [expiredBlocks addObject:[NSMutableArray array]];
+    }
+
+    pthread_mutex_lock(&_lock);
+    _armedTick = UINT64_MAX;
+    uint64_t nowTick = [self nowTick];
+    while (_currentTick < nowTick) {
+        uint64_t tick = [self nextEventTick];
+        if (tick > nowTick) {
+            _currentTick = nowTick;
+            break;
+        }
+        _currentTick = tick;
+
+        // Cascade from the highest level that starts a new slot at this tick, down to the second one.
+        NSUInteger level = 1;
+        while (level < BFTimerWheelLevelCount && (tick & ((1ull << (BFTimerWheelSlotBits * level)) - 1)) == 0) {
+            level++;
+        }
+        while (--level > 0) {
+            NSUInteger slot = (NSUInteger)((tick >> (BFTimerWheelSlotBits * level)) & BFTimerWheelSlotMask);
+            [self cascadeLevel:level slot:slot expiredBlocks:expiredBlocks];
+        }
+        [self cascadeLevel:0 slot:(NSUInteger)(tick & BFTimerWheelSlotMask) expiredBlocks:expiredBlocks];
+    }
+    [self armTimer];
+    pthread_mutex_unlock(&_lock);
+
+    // Highest priority first.
+    for (NSInteger priority = BFExecutorPriorityHigh; priority >= BFExecutorPriorityBackground; priority--) {
+        for (dispatch_block_t block in expiredBlocks[priority]) {
+            BFExecutorDispatchAsyncWithPriority((BFExecutorPriority)priority, block);
+        }
+    }
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include "BFAllocationCounter.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+static atomic_uint_fast64_t BFAllocationCount;
+
+static inline void BFAllocationCounterIncrement(void) {
+    atomic_fetch_add_explicit(&BFAllocationCount, 1, memory_order_relaxed);
+}
+
+uint64_t BFAllocationCounterCount(void) {
+    return atomic_load_explicit(&BFAllocationCount, memory_order_relaxed);
+}
+
+#if __APPLE__
+
+// The hook libmalloc calls for every allocation when malloc stack logging is on.
+typedef void (BFMallocLogger)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t skippedFrames);
+extern BFMallocLogger *malloc_logger;
+
+static const uint32_t BFMallocLogTypeAllocate = 2;
+
+static void BFAllocationCounterLog(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t skippedFrames) {
+    if (type & BFMallocLogTypeAllocate) {
+        BFAllocationCounterIncrement();
+    }
+}
+
+bool BFAllocationCounterStart(void) {
+    malloc_logger = BFAllocationCounterLog;
+    return true;
+}
+
+#elif __GLIBC__
+
+// Interposes the allocator entry points of glibc. Definitions in the executable take precedence over the ones of
+// libc for every library, including the Objective-C runtime and libdispatch.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static atomic_bool BFAllocationCounterStarted;
+
+void *malloc(size_t size) {
+    if (atomic_load_explicit(&BFAllocationCounterStarted, memory_order_relaxed)) {
+        BFAllocationCounterIncrement();
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    if (atomic_load_explicit(&BFAllocationCounterStarted, memory_order_relaxed)) {
+        BFAllocationCounterIncrement();
+    }
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+    if (atomic_load_explicit(&BFAllocationCounterStarted, memory_order_relaxed)) {
+        BFAllocationCounterIncrement();
+    }
+    return __libc_realloc(pointer, size);
+}
+
+// The aligned allocators don't go through `malloc`, and back `posix_memalign` in the Objective-C runtime among others.
+void *memalign(size_t alignment, size_t size) {
+    if (atomic_load_explicit(&BFAllocationCounterStarted, memory_order_relaxed)) {
+        BFAllocationCounterIncrement();
+    }
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size) {
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0) {
+        return EINVAL;
+    }
+    void *result = memalign(alignment, size);
+    if (!result) {
+        return ENOMEM;
+    }
+    *pointer = result;
+    return 0;
+}
+
+bool BFAllocationCounterStart(void) {
+    atomic_store_explicit(&BFAllocationCounterStarted, true, memory_order_relaxed);
+    return true;
+}
+
+#else
+
+bool BFAllocationCounterStart(void) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,22 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*!
+ Starts counting heap allocations of the whole process. Returns `false` if this platform can't count them.
+ */
+extern bool BFAllocationCounterStart(void);
+
+/*!
+ Returns the number of heap allocations made by any thread since `BFAllocationCounterStart()`.
+ */
+extern uint64_t BFAllocationCounterCount(void);
@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*!
+ Runs the measured operation the given number of times.
+ */
+typedef void (^BFBenchmarkBlock)(NSUInteger operations);
+
+/*!
+ The measurements of a benchmark. Percentiles are taken over the samples, each sample being the mean time of
+ one operation over `operationsPerSample` runs. With one operation per sample, they are operation latencies.
+ */
+@interface BFBenchmarkResult : NSObject
+
+@property (nonatomic, copy, readonly) NSString *name;
+@property (nonatomic, assign, readonly) NSUInteger samples;
+@property (nonatomic, assign, readonly) NSUInteger operationsPerSample;
+@property (nonatomic, assign, readonly) double nanosecondsPerOperation;
+@property (nonatomic, assign, readonly) double p50NanosecondsPerOperation;
+@property (nonatomic, assign, readonly) double p90NanosecondsPerOperation;
+@property (nonatomic, assign, readonly) double p99NanosecondsPerOperation;
+
+/*!
+ Heap allocations per operation, made by any thread. `NAN` if allocations can't be counted on this platform.
+ */
+@property (nonatomic, assign, readonly) double allocationsPerOperation;
+
+/*!
+ The result as a dictionary of JSON types, keyed by the property names.
+ */
+- (NSDictionary<NSString *, id> *)dictionaryRepresentation;
+
+@end
+
+/*!
+ A named operation to measure.
+ */
+@interface BFBenchmark : NSObject
+
+@property (nonatomic, copy, readonly) NSString *name;
+@property (nonatomic, assign, readonly) NSUInteger operationsPerSample;
+
+/*!
+ Creates a benchmark.
+ @param name The name the benchmark is reported and filtered with.
+ @param operationsPerSample The number of operations timed together as one sample.
+ @param block The block to run the operations with.
+ */
++ (instancetype)benchmarkWithName:(NSString *)name
+              operationsPerSample:(NSUInteger)operationsPerSample
+                            block:(BFBenchmarkBlock)block;
+
+/*!
+ Runs one warm-up sample, and then measures the given number of samples.
+ */
+- (BFBenchmarkResult *)runWithSamples:(NSUInteger)samples;
+
+@end
+
+NS_ASSUME_NONNULL_END
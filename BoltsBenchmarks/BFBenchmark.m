@@ -0,0 +1,132 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import "BFBenchmark.h"
+
+#import <math.h>
+
+#import "BFAllocationCounter.h"
+#import "BFClock.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface BFBenchmarkResult ()
+
+@property (nonatomic, copy, readwrite) NSString *name;
+@property (nonatomic, assign, readwrite) NSUInteger samples;
+@property (nonatomic, assign, readwrite) NSUInteger operationsPerSample;
+@property (nonatomic, assign, readwrite) double nanosecondsPerOperation;
+@property (nonatomic, assign, readwrite) double p50NanosecondsPerOperation;
+@property (nonatomic, assign, readwrite) double p90NanosecondsPerOperation;
+@property (nonatomic, assign, readwrite) double p99NanosecondsPerOperation;
+@property (nonatomic, assign, readwrite) double allocationsPerOperation;
+
+@end
+
+@implementation BFBenchmarkResult
+
+- (NSDictionary<NSString *, id> *)dictionaryRepresentation {
+    NSMutableDictionary<NSString *, id> *dictionary = [@{
+        @"name" : self.name,
+        @"samples" : @(self.samples),
+        @"operationsPerSample" : @(self.operationsPerSample),
+        @"nanosecondsPerOperation" : @(self.nanosecondsPerOperation),
+        @"p50NanosecondsPerOperation" : @(self.p50NanosecondsPerOperation),
+        @"p90NanosecondsPerOperation" : @(self.p90NanosecondsPerOperation),
+        @"p99NanosecondsPerOperation" : @(self.p99NanosecondsPerOperation),
+    } mutableCopy];
+    // JSON has no NaN.
+    if (!isnan(self.allocationsPerOperation)) {
+        dictionary[@"allocationsPerOperation"] = @(self.allocationsPerOperation);
+    }
+    return dictionary;
+}
+
+@end
+
+static int BFBenchmarkCompareDoubles(const void *left, const void *right) {
+    double difference = *(const double *)left - *(const double *)right;
+    return (difference > 0) - (difference < 0);
+}
+
+/*!
+ Nearest-rank percentile of sorted values.
+ */
+static double BFBenchmarkPercentile(const double *sortedValues, NSUInteger count, NSUInteger percentile) {
+    NSUInteger rank = (count * percentile + 99) / 100;
+    return sortedValues[MAX(rank, (NSUInteger)1) - 1];
+}
+
+@implementation BFBenchmark {
+    BFBenchmarkBlock _block;
+}
+
++ (instancetype)benchmarkWithName:(NSString *)name
+              operationsPerSample:(NSUInteger)operationsPerSample
+                            block:(BFBenchmarkBlock)block {
+    return [[self alloc] initWithName:name operationsPerSample:operationsPerSample block:block];
+}
+
+- (instancetype)initWithName:(NSString *)name
+         operationsPerSample:(NSUInteger)operationsPerSample
+                       block:(BFBenchmarkBlock)block {
+    self = [super init];
+    if (!self) return self;
+
+    _name = [name copy];
+    _operationsPerSample = MAX(operationsPerSample, (NSUInteger)1);
+    _block = [block copy];
+
+    return self;
+}
+
+- (BFBenchmarkResult *)runWithSamples:(NSUInteger)samples {
+    samples = MAX(samples, (NSUInteger)1);
+    BOOL countsAllocations = BFAllocationCounterStart();
+
+    @autoreleasepool {
+        _block(_operationsPerSample);
+    }
+
+    double *sampleNanoseconds = malloc(samples * sizeof(double));
+    uint64_t totalNanoseconds = 0;
+    uint64_t totalAllocations = 0;
+    for (NSUInteger i = 0; i < samples; i++) {
+        @autoreleasepool {
+            uint64_t allocations = BFAllocationCounterCount();
+            uint64_t start = BFClockNowNanoseconds();
+            _block(_operationsPerSample);
+            uint64_t elapsed = BFClockNowNanoseconds() - start;
+            totalAllocations += BFAllocationCounterCount() - allocations;
+            totalNanoseconds += elapsed;
+            sampleNanoseconds[i] = (double)elapsed / _operationsPerSample;
+        }
+    }
+
+    qsort(sampleNanoseconds, samples, sizeof(double), BFBenchmarkCompareDoubles);
+
+    double operations = (double)samples * _operationsPerSample;
+    BFBenchmarkResult *result = [BFBenchmarkResult new];
+    result.name = self.name;
+    result.samples = samples;
+    result.operationsPerSample = _operationsPerSample;
+    result.nanosecondsPerOperation = totalNanoseconds / operations;
+    result.p50NanosecondsPerOperation = BFBenchmarkPercentile(sampleNanoseconds, samples, 50);
+    result.p90NanosecondsPerOperation = BFBenchmarkPercentile(sampleNanoseconds, samples, 90);
+    result.p99NanosecondsPerOperation = BFBenchmarkPercentile(sampleNanoseconds, samples, 99);
+    result.allocationsPerOperation = countsAllocations ? totalAllocations / operations : NAN;
+
+    free(sampleNanoseconds);
+    return result;
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,272 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+#import <Bolts/Bolts.h>
+
+#import "BFBenchmark.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+static const NSUInteger BFBenchmarkDefaultSamples = 200;
+
+/*!
+ The number of tasks in a chain, a fan-in or a fan-out.
+ */
+static const NSUInteger BFBenchmarkWidth = 1000;
+
+#pragma mark - Tasks
+
+static NSArray<BFBenchmark *> *BFTaskBenchmarks(void) {
+    BFExecutor *immediateExecutor = [BFExecutor immediateExecutor];
+    BFTask *completedTask = [BFTask taskWithResult:@YES];
+
+    return @[
+        [BFBenchmark benchmarkWithName:@"task.create.completed" operationsPerSample:10000 block:^(NSUInteger operations) {
+            for (NSUInteger i = 0; i < operations; i++) {
+                [BFTask taskWithResult:@(i)];
+            }
+        }],
+        [BFBenchmark benchmarkWithName:@"task.create.source" operationsPerSample:10000 block:^(NSUInteger operations) {
+            for (NSUInteger i = 0; i < operations; i++) {
+                [[BFTaskCompletionSource taskCompletionSource] setResult:@(i)];
+            }
+        }],
+        [BFBenchmark benchmarkWithName:@"task.continue.completed" operationsPerSample:10000 block:^(NSUInteger operations) {
+            for (NSUInteger i = 0; i < operations; i++) {
+                [completedTask continueWithExecutor:immediateExecutor withBlock:^id(BFTask *task) {
+                    return nil;
+                }];
+            }
+        }],
+        [BFBenchmark benchmarkWithName:@"task.continue.pending" operationsPerSample:10000 block:^(NSUInteger operations) {
+            for (NSUInteger i = 0; i < operations; i++) {
+                BFTaskCompletionSource *source = [BFTaskCompletionSource taskCompletionSource];
+                [source.task continueWithExecutor:immediateExecutor withBlock:^id(BFTask *task) {
+                    return nil;
+                }];
+                source.result = @(i);
+            }
+        }],
+        // One operation is one link of the chain.
+        [BFBenchmark benchmarkWithName:@"task.chain" operationsPerSample:BFBenchmarkWidth block:^(NSUInteger operations) {
+            BFTaskCompletionSource *source = [BFTaskCompletionSource taskCompletionSource];
+            BFTask *task = source.task;
+            for (NSUInteger i = 0; i < operations; i++) {
+                task = [task continueWithExecutor:immediateExecutor withBlock:^id(BFTask *antecedent) {
+                    return antecedent.result;
+                }];
+            }
+            source.result = @YES;
+        }],
+        // A chain built on a completed task runs every link as it is added.
+        [BFBenchmark benchmarkWithName:@"task.chain.completed" operationsPerSample:BFBenchmarkWidth block:^(NSUInteger operations) {
+            BFTask *task = completedTask;
+            for (NSUInteger i = 0; i < operations; i++) {
+                task = [task continueWithExecutor:immediateExecutor withBlock:^id(BFTask *antecedent) {
+                    return antecedent.result;
+                }];
+            }
+        }],
+        // One operation is one task of the fan-in.
+        [BFBenchmark benchmarkWithName:@"task.fanIn" operationsPerSample:BFBenchmarkWidth block:^(NSUInteger operations) {
+            NSMutableArray<BFTaskCompletionSource *> *sources = [NSMutableArray arrayWithCapacity:operations];
+            NSMutableArray<BFTask *> *tasks = [NSMutableArray arrayWithCapacity:operations];
+            for (NSUInteger i = 0; i < operations; i++) {
+                BFTaskCompletionSource *source = [BFTaskCompletionSource taskCompletionSource];
+                [sources addObject:source];
+                [tasks addObject:source.task];
+            }
+            BFTask *task = [BFTask taskForCompletionOfAllTasksWithResults:tasks];
+            for (BFTaskCompletionSource *source in sources) {
+                source.result = @YES;
+            }
+            [task waitUntilFinished];
+        }],
+        // One operation is one continuation of the fan-out.
+        [BFBenchmark benchmarkWithName:@"task.fanOut" operationsPerSample:BFBenchmarkWidth block:^(NSUInteger operations) {
+            BFTaskCompletionSource *source = [BFTaskCompletionSource taskCompletionSource];
+            for (NSUInteger i = 0; i < operations; i++) {
+                [source.task continueWithExecutor:immediateExecutor withBlock:^id(BFTask *task) {
+                    return nil;
+                }];
+            }
+            source.result = @YES;
+        }],
+    ];
+}
+
+#pragma mark - Executors
+
+/*!
+ Measures the latency of one hop to the executor and back, one hop per sample.
+ */
+static BFBenchmark *BFExecutorHopBenchmark(NSString *name, BFExecutor *executor) {
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    return [BFBenchmark benchmarkWithName:[@"executor.hop." stringByAppendingString:name]
+                      operationsPerSample:1
+                                    block:^(NSUInteger operations) {
+                                        for (NSUInteger i = 0; i < operations; i++) {
+                                            [executor execute:^{
+                                                dispatch_semaphore_signal(semaphore);
+                                            }];
+                                            dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+                                        }
+                                    }];
+}
+
+static NSArray<BFBenchmark *> *BFExecutorBenchmarks(void) {
+    NSOperationQueue *operationQueue = [NSOperationQueue new];
+    dispatch_queue_t serialQueue = dispatch_queue_create("com.bolts.benchmarks.serial", DISPATCH_QUEUE_SERIAL);
+
+    return @[
+        BFExecutorHopBenchmark(@"default", [BFExecutor defaultExecutor]),
+        BFExecutorHopBenchmark(@"immediate", [BFExecutor immediateExecutor]),
+        BFExecutorHopBenchmark(@"mainThread", [BFExecutor mainThreadExecutor]),
+        BFExecutorHopBenchmark(@"block", [BFExecutor executorWithBlock:^(void (^block)(void)) {
+            block();
+        }]),
+        BFExecutorHopBenchmark(@"dispatchQueue", [BFExecutor executorWithDispatchQueue:serialQueue]),
+        BFExecutorHopBenchmark(@"operationQueue", [BFExecutor executorWithOperationQueue:operationQueue]),
+        BFExecutorHopBenchmark(@"threadPool", [BFExecutor threadPoolExecutor]),
+    ];
+}
+
+#pragma mark - Cancellation
+
+static NSArray<BFBenchmark *> *BFCancellationBenchmarks(void) {
+    BFCancellationTokenSource *longLivedSource = [BFCancellationTokenSource cancellationTokenSource];
+
+    return @[
+        // A token that outlives many short operations, each registering and disposing an observer.
+        [BFBenchmark benchmarkWithName:@"cancellation.register.dispose" operationsPerSample:10000 block:^(NSUInteger operations) {
+            for (NSUInteger i = 0; i < operations; i++) {
+                BFCancellationTokenRegistration *registration = [longLivedSource.token registerCancellationObserverWithBlock:^{
+                }];
+                [registration dispose];
+            }
+        }],
+        // One operation is one observer registered and then notified.
+        [BFBenchmark benchmarkWithName:@"cancellation.register.cancel" operationsPerSample:BFBenchmarkWidth block:^(NSUInteger operations) {
+            BFCancellationTokenSource *source = [BFCancellationTokenSource cancellationTokenSource];
+            for (NSUInteger i = 0; i < operations; i++) {
+                [source.token registerCancellationObserverWithBlock:^{
+                }];
+            }
+            [source cancel];
+        }],
+    ];
+}
+
+#pragma mark - Channels
+
+/*!
+ The number of objects sent and received at once by the batched channel benchmark.
+ */
+static const NSUInteger BFChannelBatchSize = 64;
+
+static NSArray<BFBenchmark *> *BFChannelBenchmarks(void) {
+    return @[
+        // One operation is one object sent and received, one at a time.
+        [BFBenchmark benchmarkWithName:@"channel.single" operationsPerSample:10000 block:^(NSUInteger operations) {
+            BFChannel *channel = [BFChannel channelWithCapacity:64];
+            for (NSUInteger i = 0; i < operations; i++) {
+                [channel send:@(i)];
+                [channel receive];
+            }
+        }],
+        // One operation is one object, sent and received in batches as large as the buffer.
+        // A multiple of the batch size, so that every operation counted is an object that went through the channel.
+        [BFBenchmark benchmarkWithName:@"channel.batch" operationsPerSample:(BFChannelBatchSize * 16) block:^(NSUInteger operations) {
+            BFChannel *channel = [BFChannel channelWithCapacity:BFChannelBatchSize];
+            NSMutableArray<NSNumber *> *objects = [NSMutableArray arrayWithCapacity:BFChannelBatchSize];
+            for (NSUInteger i = 0; i < BFChannelBatchSize; i++) {
+                [objects addObject:@(i)];
+            }
+            for (NSUInteger i = 0; i < operations; i += objects.count) {
+                [channel sendObjects:objects];
+                [channel receiveObjectsWithMaximumCount:objects.count];
+            }
+        }],
+    ];
+}
+
+#pragma mark - Main
+
+static void BFBenchmarkPrintUsage(void) {
+    fprintf(stderr, "usage: BoltsBenchmarks [--samples count] [--filter substring] [--json path]\n");
+}
+
+static void BFBenchmarkRun(NSUInteger samples, NSString *_Nullable filter, NSString *_Nullable jsonPath) {
+    NSMutableArray<BFBenchmark *> *benchmarks = [NSMutableArray array];
+    [benchmarks addObjectsFromArray:BFTaskBenchmarks()];
+    [benchmarks addObjectsFromArray:BFExecutorBenchmarks()];
+    [benchmarks addObjectsFromArray:BFCancellationBenchmarks()];
+    [benchmarks addObjectsFromArray:BFChannelBenchmarks()];
+
+    printf("%-32s %12s %12s %12s %12s %12s\n", "benchmark", "ns/op", "p50", "p90", "p99", "allocs/op");
+    NSMutableArray<NSDictionary *> *results = [NSMutableArray array];
+    for (BFBenchmark *benchmark in benchmarks) {
+        if (filter.length > 0 && [benchmark.name rangeOfString:filter].location == NSNotFound) {
+            continue;
+        }
+        BFBenchmarkResult *result = [benchmark runWithSamples:samples];
+        printf("%-32s %12.1f %12.1f %12.1f %12.1f %12.2f\n",
+               result.name.UTF8String,
+               result.nanosecondsPerOperation,
+               result.p50NanosecondsPerOperation,
+               result.p90NanosecondsPerOperation,
+               result.p99NanosecondsPerOperation,
+               result.allocationsPerOperation);
+        fflush(stdout);
+        [results addObject:[result dictionaryRepresentation]];
+    }
+
+    if (jsonPath) {
+        NSError *error = nil;
+        NSData *data = [NSJSONSerialization dataWithJSONObject:results options:NSJSONWritingPrettyPrinted error:&error];
+        if (!data || ![data writeToFile:jsonPath atomically:YES]) {
+            fprintf(stderr, "Could not write %s: %s\n", jsonPath.UTF8String, error.localizedDescription.UTF8String ?: "");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+int main(int argc, const char *argv[]) {
+    @autoreleasepool {
+        NSUInteger samples = BFBenchmarkDefaultSamples;
+        NSString *filter = nil;
+        NSString *jsonPath = nil;
+        for (int i = 1; i < argc; i++) {
+            if (i + 1 < argc && strcmp(argv[i], "--samples") == 0) {
+                samples = (NSUInteger)strtoul(argv[++i], NULL, 10);
+            } else if (i + 1 < argc && strcmp(argv[i], "--filter") == 0) {
+                filter = @(argv[++i]);
+            } else if (i + 1 < argc && strcmp(argv[i], "--json") == 0) {
+                jsonPath = @(argv[++i]);
+            } else {
+                BFBenchmarkPrintUsage();
+                return EXIT_FAILURE;
+            }
+        }
+
+        // Benchmarks run off the main thread, so that the main queue is free to serve the main thread executor.
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            @autoreleasepool {
+                BFBenchmarkRun(samples, filter, jsonPath);
+            }
+            exit(EXIT_SUCCESS);
+        });
+    }
+    dispatch_main();
+}
+
+NS_ASSUME_NONNULL_END
@@ -59,6 +59,148 @@
     XCTAssertTrue(cancelled, @"Source should be cancelled");
 }
 
+- (void)testCancellationBlockOnCancelledToken {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    [cts cancel];
+
+    __block BOOL cancelled = NO;
+    [cts.token registerCancellationObserverWithBlock:^{
+        cancelled = YES;
+    }];
+
+    XCTAssertTrue(cancelled, @"Observer should be notified immediately");
+}
+
+- (void)testCancellationBlocksInRegistrationOrder {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    NSMutableArray *notified = [NSMutableArray array];
+    NSMutableArray *expected = [NSMutableArray array];
+
+    for (int i = 0; i < 1000; i++) {
+        BFCancellationTokenRegistration *registration = [cts.token registerCancellationObserverWithBlock:^{
+            [notified addObject:@(i)];
+        }];
+        // Dispose most of them, so that the disposed ones get unlinked along the way.
+        if (i % 4 == 0) {
+            [expected addObject:@(i)];
+        } else {
+            [registration dispose];
+        }
+    }
+    [cts cancel];
+
+    XCTAssertEqualObjects(expected, notified);
+}
+
+- (void)testConcurrentRegistrationsAndCancellation {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    NSObject *lock = [[NSObject alloc] init];
+    __block NSUInteger notifiedCount = 0;
+    __block NSUInteger keptCount = 0;
+
+    dispatch_apply(10000, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        if (i == 5000) {
+            [cts cancel];
+        }
+        BFCancellationTokenRegistration *registration = [cts.token registerCancellationObserverWithBlock:^{
+            @synchronized (lock) {
+                notifiedCount++;
+            }
+        }];
+        if (i % 2 == 0) {
+            [registration dispose];
+        } else {
+            @synchronized (lock) {
+                keptCount++;
+            }
+        }
+    });
+
+    // Every registration that was kept is notified exactly once, whether it was registered before or after cancel.
+    XCTAssertTrue(notifiedCount >= keptCount);
+    XCTAssertTrue(notifiedCount <= 10000);
+}
+
+- (void)testLinkedCancellationTokenSource {
+    BFCancellationTokenSource *first = [BFCancellationTokenSource cancellationTokenSource];
+    BFCancellationTokenSource *second = [BFCancellationTokenSource cancellationTokenSource];
+    BFCancellationTokenSource *linked = [BFCancellationTokenSource cancellationTokenSourceLinkedToTokens:@[ first.token, second.token ]];
+    BFCancellationTokenSource *grandchild = [BFCancellationTokenSource cancellationTokenSourceLinkedToTokens:@[ linked.token ]];
+
+    XCTAssertFalse(linked.cancellationRequested);
+    [second cancel];
+
+    XCTAssertTrue(linked.cancellationRequested);
+    XCTAssertTrue(grandchild.cancellationRequested);
+    XCTAssertFalse(first.cancellationRequested);
+}
+
+- (void)testLinkedCancellationTokenSourceWithCancelledToken {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    [cts cancel];
+
+    BFCancellationTokenSource *linked = [BFCancellationTokenSource cancellationTokenSourceLinkedToTokens:@[ cts.token ]];
+    XCTAssertTrue(linked.cancellationRequested);
+}
+
+- (void)testLinkedCancellationTokenSourceDispose {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    BFCancellationTokenSource *linked = [BFCancellationTokenSource cancellationTokenSourceLinkedToTokens:@[ cts.token ]];
+    [linked dispose];
+
+    XCTAssertNoThrow([cts cancel]);
+    XCTAssertThrowsSpecificNamed(linked.cancellationRequested, NSException, NSInternalInconsistencyException);
+}
+
+- (void)testLinkedCancellationTokenSourceIsNotRetainedByParent {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    __weak BFCancellationTokenSource *weakLinked = nil;
+    __weak BFCancellationToken *weakLinkedToken = nil;
+
+    @autoreleasepool {
+        BFCancellationTokenSource *linked = [BFCancellationTokenSource cancellationTokenSourceLinkedToTokens:@[ cts.token ]];
+        weakLinked = linked;
+        weakLinkedToken = linked.token;
+    }
+
+    XCTAssertNil(weakLinked);
+    XCTAssertNil(weakLinkedToken);
+    XCTAssertNoThrow([cts cancel]);
+}
+
+- (void)testLinkedCancellationTokenOutlivesItsSource {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    __weak BFCancellationTokenSource *weakLinked = nil;
+    BFCancellationToken *token = nil;
+
+    @autoreleasepool {
+        BFCancellationTokenSource *linked = [BFCancellationTokenSource cancellationTokenSourceLinkedToTokens:@[ cts.token ]];
+        weakLinked = linked;
+        token = linked.token;
+    }
+
+    XCTAssertNil(weakLinked);
+    XCTAssertFalse(token.cancellationRequested);
+    [cts cancel];
+    XCTAssertTrue(token.cancellationRequested);
+}
+
+- (void)testLinkedCancellationTokenSourceTree {
+    BFCancellationTokenSource *root = [BFCancellationTokenSource cancellationTokenSource];
+    NSMutableArray *leaves = [NSMutableArray array];
+    for (int i = 0; i < 100; i++) {
+        BFCancellationTokenSource *request = [BFCancellationTokenSource cancellationTokenSourceLinkedToTokens:@[ root.token ]];
+        for (int j = 0; j < 100; j++) {
+            [leaves addObject:[BFCancellationTokenSource cancellationTokenSourceLinkedToTokens:@[ request.token ]]];
+        }
+    }
+
+    [root cancel];
+    for (BFCancellationTokenSource *leaf in leaves) {
+        XCTAssertTrue(leaf.cancellationRequested);
+    }
+}
+
 - (void)testCancellationAfterDelay {
     BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
 
@@ -76,6 +218,70 @@
     XCTAssertTrue(cts.token.cancellationRequested, @"Token should be cancelled");
 }
 
+- (void)testCancellationAfterDelayWithoutRunLoop {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"cancelled"];
+    [cts.token registerCancellationObserverWithBlock:^{
+        [expectation fulfill];
+    }];
+
+    // Background queues have no run loop running.
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [cts cancelAfterDelay:10];
+    });
+
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+    XCTAssertTrue(cts.cancellationRequested);
+}
+
+- (void)testCancellationAtDeadline {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"cancelled"];
+    [cts.token registerCancellationObserverWithBlock:^{
+        [expectation fulfill];
+    }];
+
+    [cts cancelAtDeadline:dispatch_time(DISPATCH_TIME_NOW, 500 * NSEC_PER_USEC)];
+
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+    XCTAssertTrue(cts.cancellationRequested);
+}
+
+- (void)testCancellationAtWallClockDeadline {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"cancelled"];
+    [cts.token registerCancellationObserverWithBlock:^{
+        [expectation fulfill];
+    }];
+
+    [cts cancelAtDeadline:dispatch_walltime(NULL, 50 * NSEC_PER_MSEC)];
+    XCTAssertFalse(cts.cancellationRequested);
+
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+    XCTAssertTrue(cts.cancellationRequested);
+}
+
+- (void)testCancellationAtFarWallClockDeadline {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+
+    // A wall clock deadline an hour away must neither be taken for now, nor for never.
+    [cts cancelAtDeadline:dispatch_walltime(NULL, 3600 * NSEC_PER_SEC)];
+    [[BFTask taskWithDelay:50] waitUntilFinished];
+
+    XCTAssertFalse(cts.cancellationRequested);
+    [cts cancelAtDeadline:DISPATCH_TIME_FOREVER];
+}
+
+- (void)testCancellationAtDeadlineStopped {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+
+    [cts cancelAtDeadline:dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_MSEC)];
+    [cts cancelAtDeadline:DISPATCH_TIME_FOREVER];
+    [[BFTask taskWithDelay:50] waitUntilFinished];
+
+    XCTAssertFalse(cts.cancellationRequested);
+}
+
 - (void)testCancellationAfterDelayValidation {
     BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
 
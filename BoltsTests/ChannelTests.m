@@ -0,0 +1,187 @@
+/*
+ *  Copyright (c) 2014, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under the BSD-style license found in the
+ *  LICENSE file in the root directory of this source tree. An additional grant
+ *  of patent rights can be found in the PATENTS file in the same directory.
+ *
+ */
+
+@import XCTest;
+
+#import <Bolts/Bolts.h>
+
+@interface ChannelTests : XCTestCase
+@end
+
+@implementation ChannelTests
+
+- (void)testSendThenReceive {
+    BFChannel<NSNumber *> *channel = [BFChannel channelWithCapacity:2];
+    XCTAssertEqual(2, channel.capacity);
+
+    // Sends complete right away while there is room.
+    XCTAssertTrue([channel send:@1].completed);
+    XCTAssertTrue([channel send:@2].completed);
+
+    BFTask<NSNumber *> *task = [channel receive];
+    XCTAssertTrue(task.completed);
+    XCTAssertEqualObjects(@1, task.result);
+    XCTAssertEqualObjects(@2, [channel receive].result);
+}
+
+- (void)testReceiveThenSend {
+    BFChannel<NSNumber *> *channel = [BFChannel channelWithCapacity:1];
+
+    BFTask<NSNumber *> *task = [channel receive];
+    XCTAssertFalse(task.completed);
+
+    [channel send:@1];
+    XCTAssertTrue(task.completed);
+    XCTAssertEqualObjects(@1, task.result);
+}
+
+- (void)testSendWaitsForRoom {
+    BFChannel<NSNumber *> *channel = [BFChannel channelWithCapacity:2];
+
+    BFTask *task = [channel sendObjects:@[ @1, @2, @3, @4, @5 ]];
+    XCTAssertFalse(task.completed);
+    BFTask *laterTask = [channel send:@6];
+    XCTAssertFalse(laterTask.completed);
+
+    XCTAssertEqualObjects((@[ @1, @2 ]), [channel receiveObjectsWithMaximumCount:10].result);
+    XCTAssertFalse(task.completed);
+    XCTAssertEqualObjects((@[ @3 ]), [channel receiveObjectsWithMaximumCount:1].result);
+    XCTAssertTrue(task.completed);
+    XCTAssertFalse(laterTask.completed);
+
+    // Objects of one send are never interleaved with those of a later one.
+    XCTAssertEqualObjects((@[ @4, @5 ]), [channel receiveObjectsWithMaximumCount:10].result);
+    XCTAssertTrue(laterTask.completed);
+    XCTAssertEqualObjects((@[ @6 ]), [channel receiveObjectsWithMaximumCount:10].result);
+}
+
+- (void)testReceiveBatches {
+    BFChannel<NSNumber *> *channel = [BFChannel channelWithCapacity:100];
+
+    BFTask<NSArray<NSNumber *> *> *task = [channel receiveObjectsWithMaximumCount:3];
+    XCTAssertFalse(task.completed);
+
+    [channel sendObjects:@[ @1, @2, @3, @4 ]];
+    XCTAssertEqualObjects((@[ @1, @2, @3 ]), task.result);
+    XCTAssertEqualObjects((@[ @4 ]), [channel receiveObjectsWithMaximumCount:3].result);
+}
+
+- (void)testClose {
+    BFChannel<NSNumber *> *channel = [BFChannel channelWithCapacity:1];
+    [channel send:@1];
+    BFTask *pendingSend = [channel send:@2];
+    [channel close];
+    XCTAssertTrue(channel.closed);
+
+    BFTask *send = [channel send:@3];
+    XCTAssertTrue(send.faulted);
+    XCTAssertEqualObjects(BFTaskErrorDomain, send.error.domain);
+    XCTAssertEqual(kBFChannelClosedError, send.error.code);
+
+    // Buffered objects are still received, then the end of the stream.
+    XCTAssertTrue(pendingSend.faulted);
+    XCTAssertEqual(kBFChannelClosedError, pendingSend.error.code);
+    XCTAssertEqualObjects(@1, [channel receive].result);
+    BFTask *end = [channel receive];
+    XCTAssertTrue(end.completed);
+    XCTAssertNil(end.result);
+    XCTAssertEqualObjects(@[], [channel receiveObjectsWithMaximumCount:10].result);
+}
+
+- (void)testCloseWithErrorFailsWaitingReceives {
+    BFChannel<NSNumber *> *channel = [BFChannel channelWithCapacity:1];
+    BFTask *task = [channel receiveObjectsWithMaximumCount:10];
+
+    NSError *error = [NSError errorWithDomain:@"foo" code:1 userInfo:nil];
+    [channel closeWithError:error];
+    [channel closeWithError:[NSError errorWithDomain:@"bar" code:2 userInfo:nil]];
+
+    XCTAssertEqualObjects(error, task.error);
+    XCTAssertEqualObjects(error, [channel receive].error);
+}
+
+- (void)testCloseFailsWaitingSends {
+    BFChannel<NSNumber *> *channel = [BFChannel channelWithCapacity:2];
+    [channel send:@1];
+    BFTask *partialSend = [channel sendObjects:@[ @2, @3 ]];
+    BFTask *pendingSend = [channel send:@4];
+    XCTAssertFalse(partialSend.completed);
+    XCTAssertFalse(pendingSend.completed);
+
+    NSError *error = [NSError errorWithDomain:@"foo" code:1 userInfo:nil];
+    [channel closeWithError:error];
+
+    // No receiver ever makes room, so the sends fail instead of waiting forever.
+    for (BFTask *send in @[ partialSend, pendingSend ]) {
+        XCTAssertTrue(send.faulted);
+        XCTAssertEqualObjects(BFTaskErrorDomain, send.error.domain);
+        XCTAssertEqual(kBFChannelClosedError, send.error.code);
+        XCTAssertEqualObjects(error, send.error.userInfo[NSUnderlyingErrorKey]);
+    }
+
+    // The part of a send that was buffered stays in the buffer.
+    XCTAssertEqualObjects((@[ @1, @2 ]), [channel receiveObjectsWithMaximumCount:10].result);
+    XCTAssertEqualObjects(error, [channel receive].error);
+}
+
+- (void)testInvalidArguments {
+    XCTAssertThrowsSpecificNamed([BFChannel channelWithCapacity:0], NSException, NSInvalidArgumentException);
+    XCTAssertThrowsSpecificNamed([[BFChannel channelWithCapacity:1] receiveObjectsWithMaximumCount:0],
+                                 NSException,
+                                 NSInvalidArgumentException);
+}
+
+- (void)testPipeline {
+    BFChannel<NSNumber *> *channel = [BFChannel channelWithCapacity:16];
+    const NSInteger count = 10000;
+
+    // The producer sends in batches and waits for room whenever the buffer is full.
+    __block BFTask *(^produce)(NSInteger) = nil;
+    BFTask *(^producer)(NSInteger) = ^BFTask *(NSInteger start) {
+        if (start == count) {
+            [channel close];
+            return nil;
+        }
+        NSMutableArray<NSNumber *> *objects = [NSMutableArray array];
+        for (NSInteger i = start; i < MIN(start + 10, count); i++) {
+            [objects addObject:@(i)];
+        }
+        return [[channel sendObjects:objects] continueWithExecutor:[BFExecutor defaultExecutor] withBlock:^id(BFTask *t) {
+            return produce(start + (NSInteger)objects.count);
+        }];
+    };
+    produce = producer;
+
+    __block NSInteger expected = 0;
+    __block BFTask *(^consume)(void) = nil;
+    BFTask *(^consumer)(void) = ^BFTask *{
+        return [[channel receiveObjectsWithMaximumCount:7] continueWithSuccessBlock:^id(BFTask<NSArray<NSNumber *> *> *t) {
+            if (t.result.count == 0) {
+                return nil;
+            }
+            for (NSNumber *number in t.result) {
+                XCTAssertEqual(expected, number.integerValue);
+                expected++;
+            }
+            return consume();
+        }];
+    };
+    consume = consumer;
+
+    BFTask *consumed = consume();
+    [BFTask waitUntilAllTasksFinished:@[ produce(0), consumed ]];
+    produce = nil;
+    consume = nil;
+
+    XCTAssertFalse(consumed.faulted);
+    XCTAssertEqual(count, expected);
+}
+
+@end
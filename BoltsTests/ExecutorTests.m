@@ -80,4 +80,329 @@
     [self waitForExpectationsWithTimeout:10.0 handler:nil];
 }
 
+- (void)testThreadPoolExecutor {
+    BFExecutor *executor = [BFExecutor threadPoolExecutorWithWorkerCount:4];
+
+    NSMutableArray *tasks = [NSMutableArray array];
+    for (int i = 0; i < 1000; i++) {
+        [tasks addObject:[BFTask taskFromExecutor:executor withBlock:^id {
+            XCTAssertFalse([NSThread isMainThread]);
+            return @(i);
+        }]];
+    }
+    BFTask *task = [BFTask taskForCompletionOfAllTasksWithResults:tasks];
+    [task waitUntilFinished];
+
+    XCTAssertEqual(1000, [task.result count]);
+    XCTAssertEqualObjects(@999, [task.result lastObject]);
+}
+
+- (void)testThreadPoolExecutorNestedContinuations {
+    BFExecutor *executor = [BFExecutor threadPoolExecutorWithWorkerCount:2];
+
+    BFTask *task = [BFTask taskWithResult:@0];
+    for (int i = 0; i < 100; i++) {
+        task = [task continueWithExecutor:executor withSuccessBlock:^id(BFTask *t) {
+            // Schedule more work from within a worker, which lands on that worker's own deque.
+            return [BFTask taskFromExecutor:executor withBlock:^id {
+                return @([t.result intValue] + 1);
+            }];
+        }];
+    }
+    [task waitUntilFinished];
+
+    XCTAssertEqualObjects(@100, task.result);
+}
+
+- (void)testSharedThreadPoolExecutor {
+    XCTAssertEqual([BFExecutor threadPoolExecutor], [BFExecutor threadPoolExecutor]);
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"test shared thread pool executor"];
+    [[BFExecutor threadPoolExecutor] execute:^{
+        XCTAssertFalse([NSThread isMainThread]);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+}
+
+- (void)testThreadPoolExecutorValidation {
+    XCTAssertThrowsSpecificNamed([BFExecutor threadPoolExecutorWithWorkerCount:0], NSException, NSInvalidArgumentException);
+}
+
+- (void)testThreadPoolExecutorWithPriority {
+    XCTAssertEqual(BFExecutorPriorityDefault, [BFExecutor currentPriority]);
+    XCTAssertEqual([BFExecutor threadPoolExecutorWithPriority:BFExecutorPriorityHigh],
+                   [BFExecutor threadPoolExecutorWithPriority:BFExecutorPriorityHigh]);
+
+    BFTask *task = [BFTask taskFromExecutor:[BFExecutor threadPoolExecutorWithPriority:BFExecutorPriorityHigh] withBlock:^id {
+        XCTAssertEqual(BFExecutorPriorityHigh, [BFExecutor currentPriority]);
+        // Continuations scheduled from here inherit the priority, unless they override it.
+        BFTask *inherited = [BFTask taskFromExecutor:[BFExecutor threadPoolExecutor] withBlock:^id {
+            return @([BFExecutor currentPriority]);
+        }];
+        BFTask *overridden = [BFTask taskFromExecutor:[BFExecutor threadPoolExecutorWithPriority:BFExecutorPriorityLow]
+                                            withBlock:^id {
+                                                return @([BFExecutor currentPriority]);
+                                            }];
+        return [BFTask taskForCompletionOfAllTasksWithResults:@[ inherited, overridden ]];
+    }];
+    [task waitUntilFinished];
+
+    NSArray *expectedPriorities = @[ @(BFExecutorPriorityHigh), @(BFExecutorPriorityLow) ];
+    XCTAssertEqualObjects(expectedPriorities, task.result);
+}
+
+- (void)testDelayInheritsPriority {
+    BFExecutor *executor = [BFExecutor threadPoolExecutorWithPriority:BFExecutorPriorityBackground];
+    BFTask *task = [BFTask taskFromExecutor:executor withBlock:^id {
+        return [[BFTask taskWithDelay:1] continueWithExecutor:[BFExecutor immediateExecutor] withBlock:^id(BFTask *t) {
+            return @([BFExecutor currentPriority]);
+        }];
+    }];
+    [task waitUntilFinished];
+
+    XCTAssertEqualObjects(@(BFExecutorPriorityBackground), task.result);
+}
+
+- (void)testHighPriorityRunsWhileBackgroundSaturatesThreadPool {
+    BFExecutor *backgroundExecutor = [BFExecutor threadPoolExecutorWithPriority:BFExecutorPriorityBackground];
+    BFExecutor *highPriorityExecutor = [BFExecutor threadPoolExecutorWithPriority:BFExecutorPriorityHigh];
+    NSUInteger workerCount = [NSProcessInfo processInfo].activeProcessorCount;
+    if (workerCount < 2) {
+        // A single worker has to be shared by every priority.
+        return;
+    }
+    NSUInteger backgroundCount = workerCount * 2;
+    dispatch_semaphore_t releaseSemaphore = dispatch_semaphore_create(0);
+
+    NSMutableArray *backgroundTasks = [NSMutableArray array];
+    for (NSUInteger i = 0; i < backgroundCount; i++) {
+        [backgroundTasks addObject:[BFTask taskFromExecutor:backgroundExecutor withBlock:^id {
+            dispatch_semaphore_wait(releaseSemaphore, DISPATCH_TIME_FOREVER);
+            return nil;
+        }]];
+    }
+
+    // Background blocks can't take the last worker, so this runs while all of them are still blocked.
+    XCTestExpectation *expectation = [self expectationWithDescription:NSStringFromSelector(_cmd)];
+    [highPriorityExecutor execute:^{
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+    for (NSUInteger i = 0; i < backgroundCount; i++) {
+        dispatch_semaphore_signal(releaseSemaphore);
+    }
+    [[BFTask taskForCompletionOfAllTasks:backgroundTasks] waitUntilFinished];
+}
+
+- (void)testThreadPoolExecutorWithPriorityValidation {
+    XCTAssertThrowsSpecificNamed([BFExecutor threadPoolExecutorWithPriority:(BFExecutorPriority)42],
+                                 NSException,
+                                 NSInvalidArgumentException);
+}
+
+- (void)testKeyedExecutorKeepsOrderPerKey {
+    BFKeyedExecutor *keyedExecutor = [BFKeyedExecutor keyedExecutorWithLaneCount:4];
+    XCTAssertEqual(4, keyedExecutor.laneCount);
+
+    NSUInteger keyCount = 16;
+    NSUInteger blockCount = 500;
+    NSMutableArray<NSMutableArray *> *orders = [NSMutableArray array];
+    for (NSUInteger key = 0; key < keyCount; key++) {
+        [orders addObject:[NSMutableArray array]];
+    }
+
+    // Blocks of a key never run concurrently, so they can append to its array without a lock.
+    dispatch_group_t group = dispatch_group_create();
+    for (NSUInteger i = 0; i < blockCount; i++) {
+        for (NSUInteger key = 0; key < keyCount; key++) {
+            dispatch_group_enter(group);
+            [keyedExecutor execute:^{
+                [orders[key] addObject:@(i)];
+                dispatch_group_leave(group);
+            } forKey:@(key)];
+        }
+    }
+    XCTAssertEqual(0, dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(10 * NSEC_PER_SEC))));
+
+    for (NSMutableArray *order in orders) {
+        XCTAssertEqual(blockCount, order.count);
+        for (NSUInteger i = 0; i < order.count; i++) {
+            XCTAssertEqualObjects(@(i), order[i]);
+        }
+    }
+}
+
+- (void)testKeyedExecutorContinuations {
+    BFKeyedExecutor *keyedExecutor = [BFKeyedExecutor keyedExecutorWithLaneCount:8];
+    BFExecutor *executor = [keyedExecutor executorForKey:@"entity"];
+    XCTAssertEqual(executor, [keyedExecutor executorForKey:[@"enti" stringByAppendingString:@"ty"]]);
+
+    NSMutableArray *order = [NSMutableArray array];
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    NSMutableArray *tasks = [NSMutableArray array];
+    for (int i = 0; i < 100; i++) {
+        [tasks addObject:[taskCompletionSource.task continueWithExecutor:executor withBlock:^id(BFTask *t) {
+            [order addObject:@(i)];
+            return nil;
+        }]];
+    }
+    taskCompletionSource.result = nil;
+    [[BFTask taskForCompletionOfAllTasks:tasks] waitUntilFinished];
+
+    XCTAssertEqual(100, order.count);
+    for (NSUInteger i = 0; i < order.count; i++) {
+        XCTAssertEqualObjects(@(i), order[i]);
+    }
+}
+
+- (void)testKeyedExecutorLaneYieldsToOtherBlocks {
+    NSMutableArray<dispatch_block_t> *drainBlocks = [NSMutableArray array];
+    BFExecutor *executor = [BFExecutor executorWithBlock:^(void (^block)(void)) {
+        [drainBlocks addObject:block];
+    }];
+    BFKeyedExecutor *keyedExecutor = [BFKeyedExecutor keyedExecutorWithLaneCount:1 executor:executor];
+
+    __block NSUInteger count = 0;
+    for (NSUInteger i = 0; i < 1000; i++) {
+        [keyedExecutor execute:^{
+            count++;
+        } forKey:@"key"];
+    }
+    XCTAssertEqual(1, drainBlocks.count);
+
+    // A drain block runs a bounded number of blocks, however many are pending, then hands the lane over to a new one.
+    NSUInteger drainCount = 0;
+    while (drainBlocks.count > 0) {
+        NSUInteger previousCount = count;
+        dispatch_block_t drainBlock = drainBlocks.firstObject;
+        [drainBlocks removeObjectAtIndex:0];
+        drainBlock();
+        drainCount++;
+
+        XCTAssertGreaterThan(count, previousCount);
+        XCTAssertLessThan(count - previousCount, 1000);
+        XCTAssertLessThanOrEqual(drainBlocks.count, 1);
+    }
+    XCTAssertEqual(1000, count);
+    XCTAssertGreaterThan(drainCount, 1);
+}
+
+- (void)testKeyedExecutorValidation {
+    XCTAssertThrowsSpecificNamed([BFKeyedExecutor keyedExecutorWithLaneCount:0], NSException, NSInvalidArgumentException);
+}
+
+- (void)testExecuteBlocksOnSerialQueue {
+    dispatch_queue_t queue = dispatch_queue_create("com.bolts.tests.serial", DISPATCH_QUEUE_SERIAL);
+    BFExecutor *queueExecutor = [BFExecutor executorWithDispatchQueue:queue];
+
+    NSMutableArray *order = [NSMutableArray array];
+    NSMutableArray *blocks = [NSMutableArray array];
+    for (int i = 0; i < 100; i++) {
+        [blocks addObject:^{
+            [order addObject:@(i)];
+        }];
+    }
+    [queueExecutor executeBlocks:blocks];
+    dispatch_sync(queue, ^{});
+
+    XCTAssertEqual(100, order.count);
+    XCTAssertEqualObjects(@0, order.firstObject);
+    XCTAssertEqualObjects(@99, order.lastObject);
+    for (NSUInteger i = 0; i < order.count; i++) {
+        XCTAssertEqualObjects(@(i), order[i]);
+    }
+}
+
+- (void)testExecuteBlocksOnOperationQueue {
+    NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+    BFExecutor *queueExecutor = [BFExecutor executorWithOperationQueue:queue];
+
+    __block int count = 0;
+    NSMutableArray *blocks = [NSMutableArray array];
+    for (int i = 0; i < 10; i++) {
+        [blocks addObject:^{
+            XCTAssertEqual(queue, [NSOperationQueue currentQueue]);
+            @synchronized(queue) {
+                count++;
+            }
+        }];
+    }
+    [queueExecutor executeBlocks:blocks];
+    [queue waitUntilAllOperationsAreFinished];
+
+    XCTAssertEqual(10, count);
+}
+
+- (void)testBatchedContinuationsOnConcurrentQueueRunInParallel {
+    dispatch_queue_t queue = dispatch_queue_create("com.bolts.tests.concurrent", DISPATCH_QUEUE_CONCURRENT);
+    BFExecutor *queueExecutor = [BFExecutor executorWithDispatchQueue:queue];
+    dispatch_semaphore_t firstArrived = dispatch_semaphore_create(0);
+    dispatch_semaphore_t secondArrived = dispatch_semaphore_create(0);
+
+    // Both continuations are submitted as one batch, and each one waits for the other to start.
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    BFTask *first = [taskCompletionSource.task continueWithExecutor:queueExecutor withBlock:^id(BFTask *t) {
+        dispatch_semaphore_signal(firstArrived);
+        return @(dispatch_semaphore_wait(secondArrived, dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC)) == 0);
+    }];
+    BFTask *second = [taskCompletionSource.task continueWithExecutor:queueExecutor withBlock:^id(BFTask *t) {
+        dispatch_semaphore_signal(secondArrived);
+        return @(dispatch_semaphore_wait(firstArrived, dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC)) == 0);
+    }];
+    taskCompletionSource.result = nil;
+    [BFTask waitUntilAllTasksFinished:@[ first, second ]];
+
+    XCTAssertEqualObjects(@YES, first.result);
+    XCTAssertEqualObjects(@YES, second.result);
+}
+
+- (void)testBatchedContinuationsOnGlobalQueueRunInParallel {
+    BFExecutor *queueExecutor = [BFExecutor executorWithDispatchQueue:dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0)];
+    const NSUInteger count = 4;
+    dispatch_group_t arrived = dispatch_group_create();
+    for (NSUInteger i = 0; i < count; i++) {
+        dispatch_group_enter(arrived);
+    }
+
+    // Every continuation waits for all of the others to start, which only works if none waits behind another.
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    NSMutableArray<BFTask *> *tasks = [NSMutableArray array];
+    for (NSUInteger i = 0; i < count; i++) {
+        [tasks addObject:[taskCompletionSource.task continueWithExecutor:queueExecutor withBlock:^id(BFTask *t) {
+            dispatch_group_leave(arrived);
+            return @(dispatch_group_wait(arrived, dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC)) == 0);
+        }]];
+    }
+    taskCompletionSource.result = nil;
+    [BFTask waitUntilAllTasksFinished:tasks];
+
+    for (BFTask *task in tasks) {
+        XCTAssertEqualObjects(@YES, task.result);
+    }
+}
+
+- (void)testBatchedContinuationsOnBlockExecutor {
+    __block int executions = 0;
+    dispatch_queue_t queue = dispatch_queue_create("com.bolts.tests.batch", DISPATCH_QUEUE_SERIAL);
+    BFExecutor *executor = [BFExecutor executorWithBlock:^(void (^block)(void)) {
+        executions++;
+        dispatch_async(queue, block);
+    }];
+
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    NSMutableArray *tasks = [NSMutableArray array];
+    for (int i = 0; i < 10; i++) {
+        [tasks addObject:[taskCompletionSource.task continueWithExecutor:executor withBlock:^id(BFTask *t) {
+            return nil;
+        }]];
+    }
+    taskCompletionSource.result = nil;
+    [[BFTask taskForCompletionOfAllTasks:tasks] waitUntilFinished];
+
+    // Executors without a batching strategy still get every block, one by one.
+    XCTAssertEqual(10, executions);
+}
+
 @end
@@ -10,11 +10,28 @@
 
 @import XCTest;
 
+#if __APPLE__
+#import <malloc/malloc.h>
+#endif
+#import <objc/runtime.h>
+
 #import <Bolts/Bolts.h>
 
 @interface TaskTests : XCTestCase
 @end
 
+static __unsafe_unretained BFTask *TaskTestsInstrumentedTask;
+static NSMutableArray<NSNumber *> *TaskTestsInstrumentationEventTypes;
+
+static void TaskTestsRecordInstrumentationEvent(const BFInstrumentationEvent *event) {
+    if (event->task != TaskTestsInstrumentedTask) {
+        return;
+    }
+    @synchronized(TaskTestsInstrumentationEventTypes) {
+        [TaskTestsInstrumentationEventTypes addObject:@(event->type)];
+    }
+}
+
 @implementation TaskTests
 
 - (void)testBasicOnSuccess {
@@ -129,6 +146,45 @@
     XCTAssertTrue(task.isCancelled);
 }
 
+- (void)testContinueWithTokenCancelsPendingContinuationImmediately {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
+
+    BFTask *task = [tcs.task continueWithExecutor:[BFExecutor immediateExecutor]
+                                            block:^id(BFTask *t) {
+                                                XCTFail(@"Continuation block should not be triggered");
+                                                return nil;
+                                            }
+                                cancellationToken:cts.token];
+
+    [cts cancel];
+    XCTAssertTrue(task.cancelled);
+
+    tcs.result = @"foo";
+    XCTAssertTrue(task.cancelled);
+}
+
+- (void)testContinueWithTokenReleasesContinuationOnCancellation {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
+    __weak NSObject *weakCapture = nil;
+    BFTask *task = nil;
+
+    @autoreleasepool {
+        NSObject *capture = [NSObject new];
+        weakCapture = capture;
+        task = [tcs.task continueWithBlock:^id(BFTask *t) {
+            return capture;
+        } cancellationToken:cts.token];
+        [cts cancel];
+    }
+
+    // The antecedent never completes, yet nothing of the continuation is kept by it anymore.
+    XCTAssertNil(weakCapture);
+    XCTAssertTrue(task.cancelled);
+    XCTAssertFalse(tcs.task.completed);
+}
+
 - (void)testFinishLaterWithSuccess {
     BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
     BFTask *task = [tcs.task continueWithBlock:^id(BFTask *t) {
@@ -515,6 +571,194 @@
     XCTAssertTrue(task.result != nil);
 }
 
+- (void)testTaskForCompletionOfAllTasksWithResultsNilTasks {
+    BFTask *task = [BFTask taskForCompletionOfAllTasksWithResults:nil];
+    XCTAssertTrue(task.completed);
+    XCTAssertFalse(task.faulted);
+    XCTAssertNil(task.result);
+}
+
+- (void)testTaskForCompletionOfAllTasksWithResultsKeepsInputOrder {
+    BFTaskCompletionSource *first = [BFTaskCompletionSource taskCompletionSource];
+    BFTaskCompletionSource *second = [BFTaskCompletionSource taskCompletionSource];
+    BFTaskCompletionSource *third = [BFTaskCompletionSource taskCompletionSource];
+
+    BFTask *task = [BFTask taskForCompletionOfAllTasksWithResults:@[ first.task, second.task, third.task ]];
+    third.result = @"baz";
+    second.result = nil;
+    XCTAssertFalse(task.completed);
+    first.result = @"foo";
+
+    XCTAssertTrue(task.completed);
+    NSArray *expected = @[ @"foo", [NSNull null], @"baz" ];
+    XCTAssertEqualObjects(expected, task.result);
+}
+
+- (void)testTaskForCompletionOfAllTasksErrorsInInputOrder {
+    BFTaskCompletionSource *first = [BFTaskCompletionSource taskCompletionSource];
+    BFTaskCompletionSource *second = [BFTaskCompletionSource taskCompletionSource];
+
+    BFTask *task = [BFTask taskForCompletionOfAllTasks:@[ first.task, second.task ]];
+    second.error = [NSError errorWithDomain:@"BoltsTests" code:2 userInfo:nil];
+    first.error = [NSError errorWithDomain:@"BoltsTests" code:1 userInfo:nil];
+
+    NSArray *errors = task.error.userInfo[BFTaskMultipleErrorsUserInfoKey];
+    XCTAssertEqual(2, errors.count);
+    XCTAssertEqual(1, [errors[0] code]);
+    XCTAssertEqual(2, [errors[1] code]);
+}
+
+- (void)testTaskForCompletionOfAllTasksLargeFanIn {
+    const NSUInteger kTaskCount = 10000;
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    NSMutableArray *tasks = [NSMutableArray arrayWithCapacity:kTaskCount];
+    for (NSUInteger i = 0; i < kTaskCount; i++) {
+        [tasks addObject:[taskCompletionSource.task continueWithExecutor:[BFExecutor immediateExecutor]
+                                                               withBlock:^id(BFTask *__unused t) {
+                                                                   return @(i);
+                                                               }]];
+    }
+
+    BFTask *task = [BFTask taskForCompletionOfAllTasksWithResults:tasks];
+    XCTAssertFalse(task.completed);
+    taskCompletionSource.result = nil;
+    [task waitUntilFinished];
+
+    NSArray *results = task.result;
+    XCTAssertEqual(kTaskCount, results.count);
+    for (NSUInteger i = 0; i < kTaskCount; i++) {
+        XCTAssertEqual(i, [results[i] unsignedIntegerValue]);
+    }
+}
+
+- (void)testTaskForMappingObjects {
+    NSMutableArray *objects = [NSMutableArray array];
+    for (int i = 0; i < 100; i++) {
+        [objects addObject:@(i)];
+    }
+
+    BFTask *task = [BFTask taskForMappingObjects:objects
+                                        executor:[BFExecutor defaultExecutor]
+                          maximumConcurrentCount:8
+                                       withBlock:^id(NSNumber *object) {
+                                           return [[BFTask taskWithDelay:(rand() % 5)] continueWithBlock:^id(BFTask *t) {
+                                               return @(object.intValue * 2);
+                                           }];
+                                       }];
+    [task waitUntilFinished];
+
+    NSArray *results = task.result;
+    XCTAssertEqual(100, results.count);
+    for (int i = 0; i < 100; i++) {
+        XCTAssertEqual(i * 2, [results[i] intValue]);
+    }
+}
+
+- (void)testTaskForMappingObjectsLimitsConcurrency {
+    NSMutableArray *objects = [NSMutableArray array];
+    for (int i = 0; i < 200; i++) {
+        [objects addObject:@(i)];
+    }
+    NSObject *lock = [[NSObject alloc] init];
+    __block NSUInteger inFlightCount = 0;
+    __block NSUInteger maximumInFlightCount = 0;
+
+    BFExecutor *executor = [BFExecutor executorWithDispatchQueue:dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0)];
+    BFTask *task = [BFTask taskForMappingObjects:objects
+                                        executor:executor
+                          maximumConcurrentCount:4
+                                       withBlock:^id(NSNumber *object) {
+                                           @synchronized (lock) {
+                                               inFlightCount++;
+                                               maximumInFlightCount = MAX(maximumInFlightCount, inFlightCount);
+                                           }
+                                           return [[BFTask taskWithDelay:1] continueWithBlock:^id(BFTask *t) {
+                                               @synchronized (lock) {
+                                                   inFlightCount--;
+                                               }
+                                               return object;
+                                           }];
+                                       }];
+    [task waitUntilFinished];
+
+    XCTAssertEqual(200, [task.result count]);
+    XCTAssertTrue(maximumInFlightCount <= 4);
+}
+
+- (void)testTaskForMappingObjectsSynchronousResults {
+    const NSUInteger kObjectCount = 100000;
+    NSMutableArray *objects = [NSMutableArray arrayWithCapacity:kObjectCount];
+    for (NSUInteger i = 0; i < kObjectCount; i++) {
+        [objects addObject:@(i)];
+    }
+
+    // Objects that complete right away don't grow the stack.
+    BFTask *task = [BFTask taskForMappingObjects:objects
+                                        executor:[BFExecutor immediateExecutor]
+                          maximumConcurrentCount:1
+                                       withBlock:^id(NSNumber *object) {
+                                           return object;
+                                       }];
+
+    XCTAssertTrue(task.completed);
+    XCTAssertEqualObjects(objects, task.result);
+}
+
+- (void)testTaskForMappingObjectsStopsAfterError {
+    NSMutableArray *objects = [NSMutableArray array];
+    for (int i = 0; i < 10; i++) {
+        [objects addObject:@(i)];
+    }
+    __block int startedCount = 0;
+
+    BFTask *task = [BFTask taskForMappingObjects:objects
+                                        executor:[BFExecutor immediateExecutor]
+                          maximumConcurrentCount:1
+                                       withBlock:^id(NSNumber *object) {
+                                           startedCount++;
+                                           if (object.intValue == 3) {
+                                               return [BFTask taskWithError:[NSError errorWithDomain:@"BoltsTests"
+                                                                                                code:35
+                                                                                            userInfo:nil]];
+                                           }
+                                           return object;
+                                       }];
+
+    XCTAssertTrue(task.faulted);
+    XCTAssertEqual(35, task.error.code);
+    XCTAssertEqual(4, startedCount);
+}
+
+- (void)testTaskForMappingObjectsNoObjectsImmediateCompletion {
+    BFTask *task = [BFTask taskForMappingObjects:@[]
+                                        executor:[BFExecutor defaultExecutor]
+                          maximumConcurrentCount:1
+                                       withBlock:^id(id object) {
+                                           return object;
+                                       }];
+    XCTAssertTrue(task.completed);
+    XCTAssertEqualObjects(@[], task.result);
+}
+
+- (void)testTaskForMappingObjectsValidation {
+    XCTAssertThrowsSpecificNamed([BFTask taskForMappingObjects:@[ @1 ]
+                                                      executor:[BFExecutor defaultExecutor]
+                                        maximumConcurrentCount:0
+                                                     withBlock:^id(id object) {
+                                                         return object;
+                                                     }],
+                                 NSException,
+                                 NSInvalidArgumentException);
+
+    id (^missingBlock)(id object) = nil;
+    XCTAssertThrowsSpecificNamed([BFTask taskForMappingObjects:@[ @1 ]
+                                                      executor:[BFExecutor defaultExecutor]
+                                        maximumConcurrentCount:1
+                                                     withBlock:missingBlock],
+                                 NSException,
+                                 NSInvalidArgumentException);
+}
+
 - (void)testTasksForTaskForCompletionOfAnyTasksWithSuccess {
     BFTask *task = [BFTask taskForCompletionOfAnyTask:@[[BFTask taskWithDelay:20], [BFTask taskWithResult:@"success"]]];
     [task waitUntilFinished];
@@ -591,6 +835,60 @@
     XCTAssertEqual(2, [task.error.userInfo[@"errors"] count]);
 }
 
+- (void)testTaskForCompletionOfAnyTaskCancelsLosers {
+    BFCancellationTokenSource *cancellationTokenSource = [BFCancellationTokenSource cancellationTokenSource];
+    BFTaskCompletionSource *first = [BFTaskCompletionSource taskCompletionSource];
+    BFTaskCompletionSource *second = [BFTaskCompletionSource taskCompletionSource];
+    BFTaskCompletionSource *third = [BFTaskCompletionSource taskCompletionSource];
+    [cancellationTokenSource.token registerCancellationObserverWithBlock:^{
+        [first trySetCancelled];
+        [third trySetCancelled];
+    }];
+
+    BFTask *task = [BFTask taskForCompletionOfAnyTask:@[ first.task, second.task, third.task ]
+                              cancellationTokenSource:cancellationTokenSource];
+    second.result = @"foo";
+
+    XCTAssertEqualObjects(@"foo", task.result);
+    XCTAssertTrue(cancellationTokenSource.cancellationRequested);
+    XCTAssertTrue(first.task.cancelled);
+    XCTAssertTrue(third.task.cancelled);
+}
+
+- (void)testTaskForCompletionOfAnyTaskDetachesFromLosers {
+    BFTaskCompletionSource *winner = [BFTaskCompletionSource taskCompletionSource];
+    BFTaskCompletionSource *loser = [BFTaskCompletionSource taskCompletionSource];
+    __weak BFCancellationTokenSource *weakCancellationTokenSource = nil;
+    BFTask *task = nil;
+
+    @autoreleasepool {
+        BFCancellationTokenSource *cancellationTokenSource = [BFCancellationTokenSource cancellationTokenSource];
+        weakCancellationTokenSource = cancellationTokenSource;
+        task = [BFTask taskForCompletionOfAnyTask:@[ winner.task, loser.task ]
+                          cancellationTokenSource:cancellationTokenSource];
+        winner.result = @"foo";
+    }
+
+    // Nothing registered on the pending loser keeps the combinator alive anymore.
+    XCTAssertNil(weakCancellationTokenSource);
+    XCTAssertFalse(loser.task.completed);
+    XCTAssertEqualObjects(@"foo", task.result);
+
+    loser.result = @"bar";
+    XCTAssertEqualObjects(@"foo", task.result);
+}
+
+- (void)testTaskForCompletionOfAnyTaskWithCompletedWinner {
+    BFCancellationTokenSource *cancellationTokenSource = [BFCancellationTokenSource cancellationTokenSource];
+    BFTaskCompletionSource *loser = [BFTaskCompletionSource taskCompletionSource];
+
+    BFTask *task = [BFTask taskForCompletionOfAnyTask:@[ [BFTask taskWithResult:@"foo"], loser.task ]
+                              cancellationTokenSource:cancellationTokenSource];
+
+    XCTAssertEqualObjects(@"foo", task.result);
+    XCTAssertTrue(cancellationTokenSource.cancellationRequested);
+}
+
 - (void)testWaitUntilFinished {
     BFTask *task = [[BFTask taskWithDelay:50] continueWithBlock:^id(BFTask *t) {
         return @"foo";
@@ -621,6 +919,132 @@
     XCTAssertTrue(task.cancelled, @"Task should be cancelled immediately");
 }
 
+- (void)testDelay {
+    NSDate *start = [NSDate date];
+    BFTask *task = [BFTask taskWithDelay:50];
+    [task waitUntilFinished];
+
+    XCTAssertFalse(task.faulted);
+    XCTAssertFalse(task.cancelled);
+    XCTAssertTrue([[NSDate date] timeIntervalSinceDate:start] >= 0.05);
+}
+
+- (void)testDeadline {
+    NSDate *start = [NSDate date];
+    BFTask *task = [BFTask taskWithDeadline:dispatch_time(DISPATCH_TIME_NOW, 1500 * NSEC_PER_USEC) cancellationToken:nil];
+    [task waitUntilFinished];
+
+    XCTAssertFalse(task.cancelled);
+    XCTAssertTrue([[NSDate date] timeIntervalSinceDate:start] >= 0.0015);
+}
+
+- (void)testDeadlineForeverWithToken {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    BFTask *task = [BFTask taskWithDeadline:DISPATCH_TIME_FOREVER cancellationToken:cts.token];
+    XCTAssertFalse(task.completed);
+
+    [cts cancel];
+    XCTAssertTrue(task.cancelled);
+}
+
+- (void)testManyDelays {
+    NSMutableArray *tasks = [NSMutableArray array];
+    for (int i = 0; i < 10000; i++) {
+        [tasks addObject:[BFTask taskWithDelay:(rand() % 200)]];
+    }
+    // Far away delays share the wheel with near ones.
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    BFTask *farTask = [BFTask taskWithDelay:(24 * 60 * 60 * 1000) cancellationToken:cts.token];
+
+    [[BFTask taskForCompletionOfAllTasks:tasks] waitUntilFinished];
+    for (BFTask *task in tasks) {
+        XCTAssertTrue(task.completed);
+    }
+    XCTAssertFalse(farTask.completed);
+    [cts cancel];
+    XCTAssertTrue(farTask.cancelled);
+}
+
+- (void)testDelaysOnSeveralLevels {
+    // A few milliseconds, tens of milliseconds and about a second land on different levels of the timer wheel,
+    // and all of them are pending at once.
+    NSDate *start = [NSDate date];
+    NSArray<NSNumber *> *delays = @[ @2, @50, @700 ];
+    NSMutableArray<NSNumber *> *elapsedTimes = [NSMutableArray array];
+    NSMutableArray<BFTask *> *tasks = [NSMutableArray array];
+    for (NSNumber *delay in delays.reverseObjectEnumerator) {
+        [tasks addObject:[[BFTask taskWithDelay:delay.intValue] continueWithBlock:^id(BFTask *t) {
+            @synchronized(elapsedTimes) {
+                [elapsedTimes addObject:@([[NSDate date] timeIntervalSinceDate:start] * 1000)];
+            }
+            return delay;
+        }]];
+    }
+    [[BFTask taskForCompletionOfAllTasks:tasks] waitUntilFinished];
+
+    XCTAssertEqual(delays.count, elapsedTimes.count);
+    for (NSUInteger i = 0; i < delays.count; i++) {
+        XCTAssertGreaterThanOrEqual(elapsedTimes[i].doubleValue, delays[i].doubleValue);
+    }
+}
+
+- (void)testDelayWithTokenReleasesTaskOnCancellation {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    __weak BFTask *weakTask = nil;
+
+    @autoreleasepool {
+        BFTask *task = [BFTask taskWithDelay:(60 * 1000) cancellationToken:cts.token];
+        weakTask = task;
+        [cts cancel];
+        XCTAssertTrue(task.cancelled);
+    }
+
+    // Nothing is kept alive until the delay would have expired.
+    XCTAssertNil(weakTask);
+}
+
+- (void)testTimeout {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
+
+    BFTask *task = [tcs.task timeoutAfterDelay:10 cancellationTokenSource:cts];
+    [task waitUntilFinished];
+
+    XCTAssertTrue(task.faulted);
+    XCTAssertEqualObjects(BFTaskErrorDomain, task.error.domain);
+    XCTAssertEqual(kBFTimeoutError, task.error.code);
+    XCTAssertTrue(cts.cancellationRequested);
+    XCTAssertFalse(tcs.task.completed);
+}
+
+- (void)testTimeoutWithTaskCompletingFirst {
+    BFCancellationTokenSource *cts = [BFCancellationTokenSource cancellationTokenSource];
+    BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
+    __weak BFTask *weakTask = nil;
+
+    @autoreleasepool {
+        BFTask *task = [tcs.task timeoutAfterDelay:(60 * 1000) cancellationTokenSource:cts];
+        weakTask = task;
+        tcs.result = @"foo";
+        XCTAssertEqualObjects(@"foo", task.result);
+    }
+
+    XCTAssertFalse(cts.cancellationRequested);
+    // The timer is released as soon as the task completes, rather than once it would have fired.
+    XCTAssertNil(weakTask);
+}
+
+- (void)testTimeoutPropagatesFailure {
+    BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
+    BFTask *task = [tcs.task timeoutAfterDelay:(60 * 1000)];
+    [tcs cancel];
+    XCTAssertTrue(task.cancelled);
+
+    NSError *error = [NSError errorWithDomain:@"BoltsTests" code:35 userInfo:nil];
+    BFTask *faultedTask = [[BFTask taskWithError:error] timeoutAfterDelay:(60 * 1000)];
+    XCTAssertEqualObjects(error, faultedTask.error);
+}
+
 - (void)testTaskFromExecutor {
     dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0L);
     BFExecutor *queueExecutor = [BFExecutor executorWithDispatchQueue:queue];
@@ -721,6 +1145,507 @@
     XCTAssertTrue(taskCompletionSource.task.cancelled);
 }
 
+- (void)testTrySetResultRacing {
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    __block int winners = 0;
+
+    dispatch_apply(64, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        if ([taskCompletionSource trySetResult:@(i)]) {
+            @synchronized(taskCompletionSource) {
+                winners++;
+            }
+        }
+    });
+
+    XCTAssertEqual(1, winners);
+    XCTAssertTrue(taskCompletionSource.task.completed);
+    XCTAssertNotNil(taskCompletionSource.task.result);
+}
+
+- (void)testContinuationsRacingWithCompletion {
+    for (int iteration = 0; iteration < 100; iteration++) {
+        BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+        __block int count = 0;
+
+        dispatch_group_t group = dispatch_group_create();
+        dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+        for (int i = 0; i < 50; i++) {
+            dispatch_group_async(group, queue, ^{
+                [taskCompletionSource.task continueWithExecutor:[BFExecutor immediateExecutor] withBlock:^id(BFTask *t) {
+                    XCTAssertEqualObjects(@"foo", t.result);
+                    @synchronized(taskCompletionSource) {
+                        count++;
+                    }
+                    return nil;
+                }];
+            });
+        }
+        dispatch_group_async(group, queue, ^{
+            taskCompletionSource.result = @"foo";
+        });
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+        XCTAssertEqual(50, count);
+    }
+}
+
+- (void)testContinuationsRunInRegistrationOrder {
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    NSMutableArray *order = [NSMutableArray array];
+    for (int i = 0; i < 10; i++) {
+        [taskCompletionSource.task continueWithExecutor:[BFExecutor immediateExecutor] withBlock:^id(BFTask *t) {
+            [order addObject:@(i)];
+            return nil;
+        }];
+    }
+    taskCompletionSource.result = nil;
+
+    XCTAssertEqualObjects((@[ @0, @1, @2, @3, @4, @5, @6, @7, @8, @9 ]), order);
+}
+
+#if __APPLE__
+// `malloc_size` is only available with the Darwin allocator.
+- (void)testTaskMemoryFootprint {
+    // A task is `isa`, its state word and its value slot, which holds the result, the error or the task it is linked to.
+    // Continuations live in nodes of their own, and waiters park on semaphores of their own.
+    // Leave a little room, but catch any regression that makes every task carry more than that.
+    const size_t maximumTaskSize = 32;
+
+    XCTAssertLessThanOrEqual(class_getInstanceSize([BFTask class]), maximumTaskSize);
+
+    BFTask *completedTask = [BFTask taskWithResult:@"foo"];
+    XCTAssertLessThanOrEqual(malloc_size((__bridge const void *)completedTask), maximumTaskSize);
+
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    [taskCompletionSource.task continueWithBlock:^id(BFTask *t) {
+        return nil;
+    }];
+    XCTAssertLessThanOrEqual(malloc_size((__bridge const void *)taskCompletionSource.task), maximumTaskSize);
+    taskCompletionSource.result = nil;
+}
+#endif
+
+- (void)testWaitUntilFinishedOnCompletedTask {
+    BFTask *task = [BFTask taskWithError:[NSError errorWithDomain:@"BoltsTests" code:35 userInfo:nil]];
+    [task waitUntilFinished];
+
+    XCTAssertTrue(task.faulted);
+    XCTAssertNil(task.result);
+    XCTAssertEqual(35, task.error.code);
+}
+
+- (void)testMultipleContinuationsOnPendingTask {
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    BFTask *first = [taskCompletionSource.task continueWithBlock:^id(BFTask *t) {
+        return @"first";
+    }];
+    BFTask *second = [taskCompletionSource.task continueWithBlock:^id(BFTask *t) {
+        return @"second";
+    }];
+    XCTAssertFalse(first.completed);
+    XCTAssertFalse(second.completed);
+
+    taskCompletionSource.result = nil;
+
+    XCTAssertEqualObjects(@"first", first.result);
+    XCTAssertEqualObjects(@"second", second.result);
+}
+
+- (void)testSharedCompletedTasks {
+    XCTAssertEqual([BFTask taskWithResult:nil], [BFTask taskWithResult:nil]);
+    XCTAssertEqual([BFTask taskWithResult:@YES], [BFTask taskWithResult:@YES]);
+    XCTAssertEqual([BFTask taskWithResult:@NO], [BFTask taskWithResult:@NO]);
+    XCTAssertEqual([BFTask taskWithResult:@3], [BFTask taskWithResult:@3]);
+    XCTAssertEqual([BFTask cancelledTask], [BFTask cancelledTask]);
+    XCTAssertEqual([BFTask taskForCompletionOfAllTasks:@[]], [BFTask taskWithResult:nil]);
+
+    XCTAssertNotEqual([BFTask taskWithResult:@YES], [BFTask taskWithResult:@1]);
+    XCTAssertEqualObjects(@YES, [BFTask taskWithResult:@YES].result);
+    XCTAssertEqualObjects(@3, [BFTask taskWithResult:@3].result);
+    XCTAssertTrue([BFTask cancelledTask].cancelled);
+
+    // Results of other types or values are never replaced with a shared task.
+    BFTask *doubleTask = [BFTask taskWithResult:@3.0];
+    XCTAssertEqual(0, strcmp([doubleTask.result objCType], @encode(double)));
+    XCTAssertNotEqual([BFTask taskWithResult:@1000], [BFTask taskWithResult:@1000]);
+}
+
+- (void)testContinueOnSuccessWithFaultedTaskReturnsFailure {
+    NSError *error = [NSError errorWithDomain:@"BoltsTests" code:35 userInfo:nil];
+    BFTask *task = [[BFTask taskWithError:error] continueWithSuccessBlock:^id(BFTask *t) {
+        XCTFail(@"Success block should not be triggered");
+        return nil;
+    }];
+
+    XCTAssertTrue(task.completed);
+    XCTAssertEqualObjects(error, task.error);
+}
+
+- (void)testContinueOnSuccessWithFailedTaskReturnsNewTask {
+    BFTask *faultedTask = [BFTask taskWithError:[NSError errorWithDomain:@"BoltsTests" code:35 userInfo:nil]];
+    BFTask *task = [faultedTask continueWithSuccessBlock:^id(BFTask *t) {
+        XCTFail(@"Success block should not be triggered");
+        return nil;
+    }];
+    XCTAssertNotEqual(faultedTask, task);
+    XCTAssertEqualObjects(faultedTask.error, task.error);
+
+    BFTask *cancelledTask = [BFTask cancelledTask];
+    task = [cancelledTask continueWithSuccessBlock:^id(BFTask *t) {
+        XCTFail(@"Success block should not be triggered");
+        return nil;
+    }];
+    XCTAssertNotEqual(cancelledTask, task);
+    XCTAssertTrue(task.cancelled);
+}
+
+- (void)testContinueOnSuccessWithFailedTaskGoesThroughExecutor {
+    dispatch_queue_t queue = dispatch_queue_create("bolts.tests.success", DISPATCH_QUEUE_SERIAL);
+    BFExecutor *executor = [BFExecutor executorWithDispatchQueue:queue];
+    NSError *error = [NSError errorWithDomain:@"BoltsTests" code:35 userInfo:nil];
+    dispatch_suspend(queue);
+
+    // The failure only gets to the returned task once the executor runs the continuation.
+    BFTask *task = [[BFTask taskWithError:error] continueWithExecutor:executor withSuccessBlock:^id(BFTask *t) {
+        XCTFail(@"Success block should not be triggered");
+        return nil;
+    }];
+    BFTask *cancelledTask = [[BFTask cancelledTask] continueWithExecutor:executor withSuccessBlock:^id(BFTask *t) {
+        XCTFail(@"Success block should not be triggered");
+        return nil;
+    }];
+    XCTAssertFalse(task.completed);
+    XCTAssertFalse(cancelledTask.completed);
+
+    dispatch_resume(queue);
+    [task waitUntilFinished];
+    [cancelledTask waitUntilFinished];
+    XCTAssertEqualObjects(error, task.error);
+    XCTAssertTrue(cancelledTask.cancelled);
+}
+
+- (void)testDeepContinuationChainRunsOnCompletingThread {
+    // Far deeper than the default executor nests continuations, so most links are trampolined.
+    const int chainLength = 100000;
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    NSThread *thread = [NSThread currentThread];
+    __block int count = 0;
+
+    BFTask *task = taskCompletionSource.task;
+    @autoreleasepool {
+        for (int i = 0; i < chainLength; i++) {
+            task = [task continueWithSuccessBlock:^id(BFTask *t) {
+                count++;
+                return nil;
+            }];
+        }
+    }
+    task = [task continueWithSuccessBlock:^id(BFTask *t) {
+        XCTAssertEqual(thread, [NSThread currentThread]);
+        return nil;
+    }];
+
+    taskCompletionSource.result = nil;
+
+    // The whole chain is trampolined on this thread, so it is done as soon as the result is set.
+    XCTAssertTrue(task.completed);
+    XCTAssertEqual(chainLength, count);
+}
+
+- (void)testNestedContinuationsRunImmediately {
+    __block BOOL nestedCompleted = NO;
+    [[BFTask taskWithResult:nil] continueWithBlock:^id(BFTask *t) {
+        BFTask *nested = [[BFTask taskWithResult:@"foo"] continueWithBlock:^id(BFTask *t2) {
+            return t2.result;
+        }];
+        nestedCompleted = nested.completed;
+        return nil;
+    }];
+    XCTAssertTrue(nestedCompleted);
+}
+
+- (void)testContinueCompletedTaskOnImmediateExecutor {
+    BFExecutor *executor = [BFExecutor immediateExecutor];
+    BFTask *completedTask = [BFTask taskWithResult:@"foo"];
+
+    // The outcome of the block is returned as is, without a dependent task in between.
+    BFTask *task = [completedTask continueWithExecutor:executor withBlock:^id(BFTask *t) {
+        return @YES;
+    }];
+    XCTAssertEqual([BFTask taskWithResult:@YES], task);
+
+    // A returned task is never handed out in place of the task of the continuation.
+    BFTask *returnedTask = [BFTask taskWithResult:@"bar"];
+    task = [completedTask continueWithExecutor:executor withBlock:^id(BFTask *t) {
+        return returnedTask;
+    }];
+    XCTAssertNotEqual(returnedTask, task);
+    XCTAssertEqualObjects(@"bar", task.result);
+
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    task = [completedTask continueWithExecutor:executor withBlock:^id(BFTask *t) {
+        return taskCompletionSource.task;
+    }];
+    XCTAssertFalse(task.completed);
+    taskCompletionSource.result = @"baz";
+    XCTAssertEqualObjects(@"baz", task.result);
+
+    BFCancellationTokenSource *cancellationTokenSource = [BFCancellationTokenSource cancellationTokenSource];
+    taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    task = [completedTask continueWithExecutor:executor block:^id(BFTask *t) {
+        return taskCompletionSource.task;
+    } cancellationToken:cancellationTokenSource.token];
+    [cancellationTokenSource cancel];
+    taskCompletionSource.result = @"baz";
+    XCTAssertTrue(task.cancelled);
+}
+
+- (void)testReturnedTasksInBetweenAreReleased {
+    BFTaskCompletionSource *first = [BFTaskCompletionSource taskCompletionSource];
+    BFTaskCompletionSource *second = [BFTaskCompletionSource taskCompletionSource];
+    BFTaskCompletionSource *third = [BFTaskCompletionSource taskCompletionSource];
+    __weak BFTask *weakIntermediateTask = nil;
+    BFTask *task = nil;
+
+    @autoreleasepool {
+        BFTask *intermediateTask = [second.task continueWithBlock:^id(BFTask *t) {
+            return third.task;
+        }];
+        weakIntermediateTask = intermediateTask;
+        task = [first.task continueWithBlock:^id(BFTask *t) {
+            return intermediateTask;
+        }];
+        first.result = nil;
+        second.result = nil;
+    }
+
+    // The task waits for the last returned task directly, nothing holds the one in between anymore.
+    XCTAssertNil(weakIntermediateTask);
+    XCTAssertFalse(task.completed);
+    third.result = @"foo";
+    XCTAssertEqualObjects(@"foo", task.result);
+}
+
+- (void)testTaskCompletionSourceTaskReturnedFromTwoContinuations {
+    BFExecutor *executor = [BFExecutor immediateExecutor];
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    BFTaskCompletionSource *antecedent = [BFTaskCompletionSource taskCompletionSource];
+
+    BFTask *first = [antecedent.task continueWithExecutor:executor withBlock:^id(BFTask *t) {
+        return taskCompletionSource.task;
+    }];
+    BFTask *second = [antecedent.task continueWithExecutor:executor withBlock:^id(BFTask *t) {
+        return taskCompletionSource.task;
+    }];
+    antecedent.result = nil;
+
+    // The returned task is still owned by its source, and keeps working on its own.
+    BFTask *continuation = [taskCompletionSource.task continueWithExecutor:executor withBlock:^id(BFTask *t) {
+        return [t.result stringByAppendingString:@"bar"];
+    }];
+    XCTAssertFalse(taskCompletionSource.task.completed);
+    XCTAssertNil(taskCompletionSource.task.result);
+    XCTAssertTrue([taskCompletionSource trySetResult:@"foo"]);
+    XCTAssertFalse([taskCompletionSource trySetResult:@"baz"]);
+
+    XCTAssertEqualObjects(@"foo", taskCompletionSource.task.result);
+    XCTAssertEqualObjects(@"foobar", continuation.result);
+    [BFTask waitUntilAllTasksFinished:@[ first, second ]];
+    XCTAssertEqualObjects(@"foo", first.result);
+    XCTAssertEqualObjects(@"foo", second.result);
+}
+
+- (void)testContinuationTaskReturnedFromTwoContinuations {
+    BFExecutor *executor = [BFExecutor immediateExecutor];
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    BFTask *returnedTask = [taskCompletionSource.task continueWithExecutor:executor withBlock:^id(BFTask *t) {
+        return @"foo";
+    }];
+
+    BFTask *completedTask = [BFTask taskWithResult:nil];
+    BFTask *first = [completedTask continueWithExecutor:executor withBlock:^id(BFTask *t) {
+        return returnedTask;
+    }];
+    BFTask *second = [completedTask continueWithExecutor:executor withBlock:^id(BFTask *t) {
+        return returnedTask;
+    }];
+    BFTask *continuation = [returnedTask continueWithExecutor:executor withBlock:^id(BFTask *t) {
+        return t.result;
+    }];
+    XCTAssertFalse(first.completed);
+    XCTAssertFalse(second.completed);
+
+    taskCompletionSource.result = nil;
+    [BFTask waitUntilAllTasksFinished:@[ first, second ]];
+    XCTAssertEqualObjects(@"foo", returnedTask.result);
+    XCTAssertEqualObjects(@"foo", continuation.result);
+    XCTAssertEqualObjects(@"foo", first.result);
+    XCTAssertEqualObjects(@"foo", second.result);
+}
+
+- (BFTask *)countDownFrom:(int)count {
+    if (count == 0) {
+        return [BFTask taskWithResult:@"done"];
+    }
+    return [BFTask taskFromExecutor:[BFExecutor threadPoolExecutor] withBlock:^id {
+        return [self countDownFrom:count - 1];
+    }];
+}
+
+- (void)testDeepRecursionThroughReturnedTasks {
+    BFTask *task = [self countDownFrom:10000];
+    [task waitUntilFinished];
+    XCTAssertEqualObjects(@"done", task.result);
+}
+
+- (void)testWaitUntilFinishedOnLinkedTask {
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    BFTask *task = [[BFTask taskWithDelay:10] continueWithBlock:^id(BFTask *t) {
+        return taskCompletionSource.task;
+    }];
+
+    // The returned task is linked to the dependent one while this thread waits for it.
+    [[BFTask taskWithDelay:50] continueWithBlock:^id(BFTask *t) {
+        taskCompletionSource.result = @"foo";
+        return nil;
+    }];
+    [taskCompletionSource.task waitUntilFinished];
+
+    XCTAssertEqualObjects(@"foo", taskCompletionSource.task.result);
+    [task waitUntilFinished];
+    XCTAssertEqualObjects(@"foo", task.result);
+}
+
+- (void)testWaitUntilFinishedOnTrampolinedContinuation {
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    __block BFTask *waitedTask = nil;
+
+    // Deeper than the default executor nests continuations.
+    BFTask *task = taskCompletionSource.task;
+    for (int i = 0; i < 1000; i++) {
+        task = [task continueWithBlock:^id(BFTask *t) {
+            return nil;
+        }];
+    }
+    [task continueWithBlock:^id(BFTask *t) {
+        // This continuation is deferred on the current thread, waiting must not deadlock on it.
+        waitedTask = [[BFTask taskWithResult:@"foo"] continueWithBlock:^id(BFTask *t2) {
+            return t2.result;
+        }];
+        [waitedTask waitUntilFinished];
+        return nil;
+    }];
+    taskCompletionSource.result = nil;
+
+    XCTAssertEqualObjects(@"foo", waitedTask.result);
+}
+
+- (void)testWaitInsideNestedContinuationOnlyRunsWhatItWaitsFor {
+    NSMutableArray<NSString *> *order = [NSMutableArray array];
+    __block BOOL nesting = YES;
+    __block BFTask *laterTask = nil;
+
+    // Nests continuations of the default executor until it defers one, then waits for that one from there.
+    __block void (^nest)(void) = nil;
+    void (^nestOnce)(void) = ^{
+        __block BOOL ran = NO;
+        BFTask *deferredTask = [[BFTask taskWithResult:nil] continueWithBlock:^id(BFTask *t) {
+            ran = YES;
+            if (nesting) {
+                nest();
+            } else {
+                [order addObject:@"deferred"];
+            }
+            return nil;
+        }];
+        if (ran || !nesting) {
+            return;
+        }
+        nesting = NO;
+        laterTask = [[BFTask taskWithResult:nil] continueWithBlock:^id(BFTask *t) {
+            [order addObject:@"later"];
+            return nil;
+        }];
+
+        [deferredTask waitUntilFinished];
+        [order addObject:@"waited"];
+        // The continuation deferred after the awaited one is still left to the outermost continuation.
+        XCTAssertFalse(laterTask.completed);
+    };
+    nest = nestOnce;
+    nest();
+    nest = nil;
+
+    XCTAssertTrue(laterTask.completed);
+    XCTAssertEqualObjects((@[ @"deferred", @"waited", @"later" ]), order);
+}
+
+- (void)testWaitUntilFinishedWithTimeout {
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+
+    XCTAssertFalse([taskCompletionSource.task waitUntilFinishedWithTimeout:10]);
+    XCTAssertFalse([taskCompletionSource.task waitUntilFinishedBeforeDeadline:DISPATCH_TIME_NOW]);
+
+    [[BFTask taskWithDelay:10] continueWithBlock:^id(BFTask *t) {
+        taskCompletionSource.result = @"foo";
+        return nil;
+    }];
+    XCTAssertTrue([taskCompletionSource.task waitUntilFinishedWithTimeout:10000]);
+    XCTAssertEqualObjects(@"foo", taskCompletionSource.task.result);
+
+    // A completed task doesn't wait at all.
+    XCTAssertTrue([taskCompletionSource.task waitUntilFinishedBeforeDeadline:DISPATCH_TIME_NOW]);
+}
+
+- (void)testWaitUntilAllTasksFinished {
+    NSMutableArray<BFTask *> *tasks = [NSMutableArray array];
+    for (int i = 0; i < 20; i++) {
+        [tasks addObject:[[BFTask taskWithDelay:i] continueWithBlock:^id(BFTask *t) {
+            return @(i);
+        }]];
+    }
+    [tasks addObject:[BFTask taskWithResult:@"foo"]];
+
+    [BFTask waitUntilAllTasksFinished:tasks];
+    for (BFTask *task in tasks) {
+        XCTAssertTrue(task.completed);
+    }
+
+    XCTAssertTrue([BFTask waitUntilAllTasksFinished:@[] deadline:DISPATCH_TIME_NOW]);
+    XCTAssertTrue([BFTask waitUntilAllTasksFinished:nil deadline:DISPATCH_TIME_NOW]);
+}
+
+- (void)testWaitUntilAllTasksFinishedWithDeadline {
+    BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+    NSArray<BFTask *> *tasks = @[ [BFTask taskWithDelay:1], taskCompletionSource.task ];
+
+    // One task that never completes before the deadline keeps the whole wait from succeeding.
+    XCTAssertFalse([BFTask waitUntilAllTasksFinished:tasks deadline:dispatch_time(DISPATCH_TIME_NOW, 50 * NSEC_PER_MSEC)]);
+    XCTAssertTrue(tasks[0].completed);
+    XCTAssertFalse(tasks[1].completed);
+
+    // The hooks of the timed out wait are gone, the task still completes normally.
+    taskCompletionSource.result = @"foo";
+    XCTAssertTrue([BFTask waitUntilAllTasksFinished:tasks deadline:DISPATCH_TIME_FOREVER]);
+    XCTAssertEqualObjects(@"foo", tasks[1].result);
+}
+
+- (void)testFanOutPerformance {
+    // The continuations are submitted to a global queue as a single batch.
+    BFExecutor *executor = [BFExecutor executorWithDispatchQueue:dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0)];
+    [self measureBlock:^{
+        BFTaskCompletionSource *taskCompletionSource = [BFTaskCompletionSource taskCompletionSource];
+        NSMutableArray *tasks = [NSMutableArray arrayWithCapacity:1000];
+        for (int i = 0; i < 1000; i++) {
+            [tasks addObject:[taskCompletionSource.task continueWithExecutor:executor withBlock:^id(BFTask *t) {
+                return t.result;
+            }]];
+        }
+        taskCompletionSource.result = @"foo";
+        [[BFTask taskForCompletionOfAllTasks:tasks] waitUntilFinished];
+    }];
+}
+
 - (void)testMultipleWaitUntilFinished {
     BFTask *task = [[BFTask taskWithDelay:50] continueWithBlock:^id(BFTask *t) {
         return @"foo";
@@ -760,4 +1685,172 @@
     [self waitForExpectationsWithTimeout:10.0 handler:nil];
 }
 
+- (void)testInstrumentationDisabledByDefault {
+    XCTAssertFalse([BFInstrumentation isEnabled]);
+    XCTAssertTrue([BFInstrumentation eventObserver] == NULL);
+}
+
+- (void)testInstrumentationEvents {
+    BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
+    TaskTestsInstrumentedTask = tcs.task;
+    TaskTestsInstrumentationEventTypes = [NSMutableArray array];
+    [BFInstrumentation setEventObserver:TaskTestsRecordInstrumentationEvent];
+    [BFInstrumentation setEnabled:YES];
+
+    BFTask *task = [tcs.task continueWithExecutor:[BFExecutor immediateExecutor] withBlock:^id(BFTask *t) {
+        return nil;
+    }];
+    tcs.result = @"foo";
+
+    [BFInstrumentation setEnabled:NO];
+    [BFInstrumentation setEventObserver:NULL];
+    TaskTestsInstrumentedTask = nil;
+
+    XCTAssertTrue(task.completed);
+    NSArray *expectedEventTypes = @[ @(BFInstrumentationEventTypeContinuationRegistered),
+                                     @(BFInstrumentationEventTypeTaskCompleted),
+                                     @(BFInstrumentationEventTypeContinuationScheduled),
+                                     @(BFInstrumentationEventTypeContinuationStarted),
+                                     @(BFInstrumentationEventTypeContinuationFinished) ];
+    XCTAssertEqualObjects(expectedEventTypes, TaskTestsInstrumentationEventTypes);
+}
+
+- (void)testInstrumentationCounters {
+    const NSUInteger count = 10;
+    [BFInstrumentation resetCounters];
+    [BFInstrumentation setEnabled:YES];
+
+    BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
+    for (NSUInteger i = 0; i < count; i++) {
+        [tcs.task continueWithExecutor:[BFExecutor immediateExecutor] withBlock:^id(BFTask *t) {
+            return nil;
+        }];
+    }
+    tcs.result = @"foo";
+
+    [BFInstrumentation setEnabled:NO];
+
+    // Other tests may still have work in flight, which is counted too.
+    BFInstrumentationCounters counters = [BFInstrumentation counters];
+    XCTAssertGreaterThanOrEqual(counters.tasksCreated, count + 1);
+    XCTAssertGreaterThanOrEqual(counters.tasksCompleted, count + 1);
+    XCTAssertGreaterThanOrEqual(counters.continuationsRegistered, count);
+    XCTAssertGreaterThanOrEqual(counters.continuationsScheduled, count);
+    XCTAssertGreaterThanOrEqual(counters.continuationsStarted, count);
+    XCTAssertGreaterThanOrEqual(counters.continuationsFinished, count);
+
+    [BFInstrumentation resetCounters];
+    XCTAssertEqual(0, [BFInstrumentation counters].tasksCreated);
+}
+
+- (void)testInstrumentationQueuedContinuationsPerExecutor {
+    const NSUInteger count = 3;
+    dispatch_queue_t queue = dispatch_queue_create("bolts.tests.instrumentation", DISPATCH_QUEUE_SERIAL);
+    BFExecutor *executor = [BFExecutor executorWithDispatchQueue:queue];
+    BFExecutor *otherExecutor = [BFExecutor executorWithDispatchQueue:queue];
+    dispatch_suspend(queue);
+    [BFInstrumentation setEnabled:YES];
+
+    NSMutableArray<BFTask *> *tasks = [NSMutableArray array];
+    for (NSUInteger i = 0; i < count; i++) {
+        [tasks addObject:[[BFTask taskWithResult:@"foo"] continueWithExecutor:executor withBlock:^id(BFTask *t) {
+            return nil;
+        }]];
+    }
+
+    [BFInstrumentation setEnabled:NO];
+
+    XCTAssertEqual(count, [BFInstrumentation queuedContinuationCountForExecutor:executor]);
+    XCTAssertEqual(0, [BFInstrumentation queuedContinuationCountForExecutor:otherExecutor]);
+
+    dispatch_resume(queue);
+    [[BFTask taskForCompletionOfAllTasks:tasks] waitUntilFinished];
+    XCTAssertEqual(0, [BFInstrumentation queuedContinuationCountForExecutor:executor]);
+}
+
+- (void)testInstrumentationKeepsOutcomesOfCompletedTasks {
+    BFExecutor *executor = [BFExecutor immediateExecutor];
+    BFTask *completedTask = [BFTask taskWithResult:@"foo"];
+    BFTask *returnedTask = [BFTask taskWithResult:@"bar"];
+    [BFInstrumentation resetCounters];
+    [BFInstrumentation setEnabled:YES];
+
+    // Continuations run right away return the same tasks as without instrumentation, and are still counted.
+    BFTask *task = [completedTask continueWithExecutor:executor withBlock:^id(BFTask *t) {
+        return @YES;
+    }];
+    BFTask *forwardingTask = [completedTask continueWithExecutor:executor withBlock:^id(BFTask *t) {
+        return returnedTask;
+    }];
+
+    [BFInstrumentation setEnabled:NO];
+
+    XCTAssertEqual([BFTask taskWithResult:@YES], task);
+    XCTAssertNotEqual(returnedTask, forwardingTask);
+    XCTAssertEqualObjects(@"bar", forwardingTask.result);
+
+    BFInstrumentationCounters counters = [BFInstrumentation counters];
+    XCTAssertGreaterThanOrEqual(counters.continuationsRegistered, 2);
+    XCTAssertGreaterThanOrEqual(counters.continuationsStarted, 2);
+    XCTAssertGreaterThanOrEqual(counters.continuationsFinished, 2);
+    [BFInstrumentation resetCounters];
+}
+
+- (void)testInstrumentationCountsDeallocationOfCountedTasks {
+    const NSUInteger count = 10;
+    [BFInstrumentation resetCounters];
+
+    @autoreleasepool {
+        [BFInstrumentation setEnabled:YES];
+        NSMutableArray<BFTask *> *tasks = [NSMutableArray array];
+        for (NSUInteger i = 0; i < count; i++) {
+            [tasks addObject:[BFTaskCompletionSource taskCompletionSource].task];
+        }
+        // The tasks go away once instrumentation is disabled, and are counted all the same.
+        [BFInstrumentation setEnabled:NO];
+        [tasks removeAllObjects];
+    }
+
+    BFInstrumentationCounters counters = [BFInstrumentation counters];
+    XCTAssertGreaterThanOrEqual(counters.tasksCreated, count);
+    XCTAssertGreaterThanOrEqual(counters.tasksDeallocated, count);
+    [BFInstrumentation resetCounters];
+}
+
+- (void)testTracingExportsContinuations {
+    [BFTaskTracing startTracing];
+    XCTAssertTrue([BFTaskTracing isTracing]);
+
+    BFTaskCompletionSource *tcs = [BFTaskCompletionSource taskCompletionSource];
+    BFTask *task = [tcs.task continueWithExecutor:[BFExecutor immediateExecutor] withBlock:^id(BFTask *t) {
+        return nil;
+    }];
+    tcs.result = @"foo";
+
+    [BFTaskTracing stopTracing];
+    XCTAssertFalse([BFTaskTracing isTracing]);
+    XCTAssertFalse([BFInstrumentation isEnabled]);
+
+    NSDictionary *trace = [NSJSONSerialization JSONObjectWithData:[BFTaskTracing traceData] options:0 error:NULL];
+    NSArray<NSDictionary *> *traceEvents = trace[@"traceEvents"];
+    NSString *taskIdentifier = [NSString stringWithFormat:@"0x%llx", (unsigned long long)(uintptr_t)(__bridge void *)tcs.task];
+    NSString *dependentTaskIdentifier = [NSString stringWithFormat:@"0x%llx",
+                                         (unsigned long long)(uintptr_t)(__bridge void *)task];
+
+    NSDictionary *slice = nil;
+    for (NSDictionary *traceEvent in traceEvents) {
+        if ([traceEvent[@"ph"] isEqual:@"B"] && [traceEvent[@"args"][@"task"] isEqual:taskIdentifier]) {
+            slice = traceEvent;
+        }
+    }
+    XCTAssertEqualObjects(@"immediateExecutor", slice[@"name"]);
+    XCTAssertEqualObjects(dependentTaskIdentifier, slice[@"args"][@"dependentTask"]);
+    XCTAssertNotNil(slice[@"args"][@"queuedMicroseconds"]);
+
+    NSSet *phases = [NSSet setWithArray:[traceEvents valueForKey:@"ph"]];
+    for (NSString *phase in @[ @"b", @"e", @"s", @"f", @"B", @"E" ]) {
+        XCTAssertTrue([phases containsObject:phase], @"Missing phase %@", phase);
+    }
+}
+
 @end
@@ -0,0 +1,63 @@
+#!/bin/bash
+#
+# Copyright 2010-present Facebook.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+# 
+#    http://www.apache.org/licenses/LICENSE-2.0
+# 
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# This script builds the task and executor micro-benchmarks with clang and runs them headless.
+# It needs no Xcode: on Linux it builds against GNUstep Base, libobjc2 and libdispatch (gnustep-config must be
+# on the PATH), on macOS against Foundation.
+#
+# Any argument is passed on to the benchmarks, for example:
+#   scripts/run_benchmarks.sh --samples 500 --filter task. --json build/benchmarks/results.json
+
+. ${BOLTS_SCRIPT:-$(dirname $0)}/common.sh
+
+test -n "$CLANG" || CLANG=$(which clang)
+test -x "$CLANG" || die 'Could not find clang, set $CLANG'
+
+BOLTS_BENCHMARKS_BUILD=$BOLTS_BUILD/benchmarks
+BOLTS_BENCHMARKS_EXECUTABLE=$BOLTS_BENCHMARKS_BUILD/BoltsBenchmarks
+
+# The benchmarks import <Bolts/Bolts.h>, like an app linking the framework.
+mkdir -p "$BOLTS_BENCHMARKS_BUILD/include/Bolts" || die 'Could not create the benchmarks build directory'
+cp "$BOLTS_SRC"/Bolts/Common/*.h "$BOLTS_BENCHMARKS_BUILD/include/Bolts/" || die 'Could not copy the Bolts headers'
+
+BOLTS_BENCHMARKS_FLAGS=(-O2 -DNDEBUG -fobjc-arc -fblocks
+  -I"$BOLTS_BENCHMARKS_BUILD/include"
+  -I"$BOLTS_SRC/Bolts/Common"
+  -I"$BOLTS_SRC/Bolts/Common/Internal"
+  -I"$BOLTS_SRC/BoltsBenchmarks")
+if [ "$(uname)" == "Darwin" ]; then
+  BOLTS_BENCHMARKS_LIBS=(-framework Foundation)
+else
+  which gnustep-config >/dev/null || die 'Could not find gnustep-config'
+  BOLTS_BENCHMARKS_FLAGS+=($(gnustep-config --objc-flags))
+  BOLTS_BENCHMARKS_LIBS=($(gnustep-config --base-libs) -ldispatch -lpthread -lm)
+fi
+
+progress_message Building benchmarks.
+"$CLANG" "${BOLTS_BENCHMARKS_FLAGS[@]}" \
+  "$BOLTS_SRC"/Bolts/Common/*.m \
+  "$BOLTS_SRC"/Bolts/Common/Internal/*.m \
+  "$BOLTS_SRC"/BoltsBenchmarks/*.m \
+  "$BOLTS_SRC"/BoltsBenchmarks/*.c \
+  "${BOLTS_BENCHMARKS_LIBS[@]}" \
+  -o "$BOLTS_BENCHMARKS_EXECUTABLE" \
+  || die 'Could not build the benchmarks'
+
+progress_message Running benchmarks.
+"$BOLTS_BENCHMARKS_EXECUTABLE" "$@" || die 'Benchmarks failed'
+
+common_success